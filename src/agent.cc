@@ -1,6 +1,5 @@
 #include <iostream>
 #include <cstring>
-#include <ctime>
 #include <cmath>
 
 #include "agent.h"
@@ -10,47 +9,133 @@
 using namespace std;
 
 Agent::Agent()
-    : trans(22)
+    : own_trans(new Transposition(22))
+    , trans(*own_trans)
+    , thread_index(0)
+    , own_stop(false)
+    , stop(own_stop)
+    , parallel_mode(LAZY_SMP)
+    , own_searching(new atomic<uint64_t>[1 << SEARCHING_BITS]())
+    , searching(own_searching)
+    , background_board(NULL)
+    , ponder_expected(0)
+    , background_result(0)
+    , background_score(0)
+    , background_done(false)
+    , analyzing(false)
+    , soft_limit(0)
+    , stretch(0)
+    , report_depth(0)
+    , report_score(0)
+    , report_interval(1000)
+    , root_moves_count(0)
+    , root_move_index(0)
+    , root_move(0)
+    , status_requested(false)
 {
+    last_pv.count = 0;
+    report_pv.count = 0;
 }
 
-int Agent::select_best_move(int *scores, int moves_count)
+Agent::Agent(Agent *owner, int index)
+    : own_trans(NULL)
+    , trans(owner->trans)
+    , thread_index(index)
+    , own_stop(false)
+    , stop(owner->stop)
+    , parallel_mode(owner->parallel_mode)
+    , own_searching(NULL)
+    , searching(owner->searching)
+    , background_board(NULL)
+    , ponder_expected(0)
+    , background_result(0)
+    , background_score(0)
+    , background_done(false)
+    , analyzing(false)
+    , soft_limit(0)
+    , stretch(0)
+    , report_depth(0)
+    , report_score(0)
+    , report_interval(1000)
+    , root_moves_count(0)
+    , root_move_index(0)
+    , root_move(0)
+    , status_requested(false)
 {
-    int best = scores[0], besti = 0;
+    last_pv.count = 0;
+    report_pv.count = 0;
+}
+
+Agent::~Agent()
+{
+    stop_background();
+    set_threads(1);
+    if (own_trans)
+    {
+        delete own_trans;
+        own_trans = NULL;
+    }
+    if (own_searching)
+    {
+        delete[] own_searching;
+        own_searching = NULL;
+    }
+}
+
+void Agent::set_threads(int threads)
+{
+    if (threads < 1)
+        threads = 1;
+    while ((int) helpers.size() > threads - 1)
+    {
+        delete helpers.back();
+        helpers.pop_back();
+    }
+    while ((int) helpers.size() < threads - 1)
+        helpers.push_back(new Agent(this, (int) helpers.size() + 1));
+}
+
+void Agent::set_parallel_mode(ParallelMode mode)
+{
+    parallel_mode = mode;
+    for (size_t k = 0; k < helpers.size(); ++k)
+        helpers[k]->parallel_mode = mode;
+}
+
+int Agent::select_best_move(FULL_MOVE *moves, int moves_count)
+{
+    int best = order_score(moves[0]), besti = 0;
     for (int i = 1; i < moves_count; ++i)
-        if (scores[i] > Board::NON_CAPTURE && scores[i] > best)
+    {
+        int score = order_score(moves[i]);
+        if (score > Board::NON_CAPTURE && score > best)
         {
-            best = scores[i];
+            best = score;
             besti = i;
         }
+    }
     return besti;
 }
 
-void Agent::order_moves(MOVE *moves, int *scores, int moves_count, int order_count)
+void Agent::order_moves(FULL_MOVE *moves, int moves_count, int order_count)
 {
     while (order_count > 0 && moves_count > 0)
     {
-        int besti = select_best_move(scores, moves_count);
+        int besti = select_best_move(moves, moves_count);
         if (besti != 0)
         {
-            MOVE t = moves[besti];
+            FULL_MOVE t = moves[besti];
             for (int i = besti; i > 0; --i)
                 moves[i] = moves[i - 1];
             moves[0] = t;
-
-            int tt = scores[besti];
-            for (int i = besti; i > 0; --i)
-                scores[i] = scores[i - 1];
-            scores[0] = tt;
         }
         --moves_count;
         --order_count;
         ++moves;
-        ++scores;
     }
 }
 
-double Agent::ebf(int nodes, int depth)
+double Agent::ebf(uint64_t nodes, int depth)
 {
     double t = pow((double) nodes, 1.f / (double) depth);
     t = pow(((t - 1) * nodes / t + 1), 1.f / (double) depth);
@@ -82,27 +167,181 @@ bool Agent::special_move_type(MoveType mt, int *score, bool *store_tt)
         return false;
 }
 
-int Agent::search(Board &board, int side, MOVE *result, int time_limit, int depth)
+bool Agent::is_perpetual(Board &board, MOVE move)
 {
-    nodes = 0;
+    MoveType mt;
+    board.move(move, &mt);
+    board.unmove();
+    return mt == PERPETUAL_CHECK_OR_CHASE;
+}
 
-    search_start_time = clock();
-    clock_t deadline = search_start_time + (double) time_limit / 1000. * (double) CLOCKS_PER_SEC;
-    int ret = id(board, side, result, deadline, &depth);
-    clock_t t = clock() - search_start_time;
+int Agent::search(Board &board, int side, MOVE *result, int soft_limit, int hard_limit, int depth)
+{
+    stop = false;
+    this->soft_limit = soft_limit;
+    return run_search(board, side, result, hard_limit, depth);
+}
 
-    double sec = (double) t / (double) CLOCKS_PER_SEC;
-    cout << "# total nodes: " << readable_number(nodes)
-        << ", EBF: " << ebf(nodes, depth)
-        << ", NPS: " << (double) nodes / sec / 1000000. << "m in " << sec << "s" << endl;
+int Agent::run_search(Board &board, int side, MOVE *result, int hard_limit, int depth)
+{
+    // killer and the PV hold one entry for each ply of the deepest iteration
+    depth = min(depth, MAX_DEPTH);
+    nodes = 0;
+    last_pv.count = 0;
+
+    search_start_time = chrono::steady_clock::now();
+    TimePoint deadline = search_start_time + chrono::milliseconds(hard_limit);
+    next_report = search_start_time + chrono::milliseconds(report_interval);
+    report_depth = 0;
+    report_pv.count = 0;
+    FULL_MOVE root_moves[120];
+    board.generate_moves(side, root_moves, &root_moves_count);
+    board.mark_history();
+
+    // The helpers' boards are copied before any thread starts moving on this one. id writes
+    // back the depth it completed, so each thread gets its own copy of the limit.
+    vector<Board> boards(helpers.size(), board);
+    vector<thread> threads;
+    const int max_depth = depth;
+    for (size_t k = 0; k < helpers.size(); ++k)
+        threads.push_back(thread([&, k, max_depth]()
+                    {
+                        MOVE helper_result;
+                        int helper_depth = max_depth;
+                        helpers[k]->nodes = 0;
+                        helpers[k]->id(boards[k], side, &helper_result, deadline, &helper_depth);
+                    }));
+
+    int completed_depth = max_depth;
+    int ret = id(board, side, result, deadline, &completed_depth);
+    stop = true;
+    uint64_t total_nodes = nodes;
+    for (size_t k = 0; k < threads.size(); ++k)
+    {
+        threads[k].join();
+        total_nodes += helpers[k]->nodes;
+    }
+    board.clear_history_mark();
+
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - search_start_time).count();
+    cout << "# total nodes: " << readable_number(total_nodes)
+        << ", EBF: " << ebf(total_nodes, completed_depth)
+        << ", NPS: " << (double) total_nodes / sec / 1000000. << "m in " << sec << "s" << endl;
     cout << "# " << board.fen_string(side) << endl;
 
     return ret;
 }
 
+void Agent::start_background(int side)
+{
+    // stop and the limits are set here rather than in the thread, so neither a stop nor
+    // finish_ponder can come before them
+    background_done = false;
+    stop = false;
+    soft_limit = BACKGROUND_TIME_LIMIT;
+    stretch = 0;
+    background_thread = thread([this, side]()
+            {
+                int score = run_search(*background_board, side, &background_result,
+                        BACKGROUND_TIME_LIMIT, MAX_DEPTH);
+                lock_guard<mutex> lock(background_mutex);
+                background_score = score;
+                background_done = true;
+                background_finished.notify_all();
+            });
+}
+
+bool Agent::start_ponder(Board &board, int side)
+{
+    stop_background();
+    if (last_pv.count < 2)
+        return false;
+
+    background_board = new Board(board);
+    if (!background_board->checked_move(side, last_pv.moves[1]))
+    {
+        delete background_board;
+        background_board = NULL;
+        return false;
+    }
+
+    ponder_expected = last_pv.moves[1];
+    start_background(1 - side);
+    return true;
+}
+
+int Agent::finish_ponder(MOVE *result, int soft_limit, int hard_limit)
+{
+    // The search started when pondering did, so the time pondered counts against the soft
+    // limit; a best move that already holds needs no more time. The hard limit only runs
+    // from the hit, as the clock does.
+    this->soft_limit = soft_limit;
+    if (!soft_limit_reached())
+    {
+        unique_lock<mutex> lock(background_mutex);
+        background_finished.wait_for(lock, chrono::milliseconds(hard_limit), [this]() { return background_done; });
+    }
+    stop = true;
+    background_thread.join();
+
+    delete background_board;
+    background_board = NULL;
+    ponder_expected = 0;
+    analyzing = false;
+    *result = background_result;
+    return background_score;
+}
+
+void Agent::start_analysis(Board &board, int side)
+{
+    stop_background();
+    background_board = new Board(board);
+    analyzing = true;
+    start_background(side);
+}
+
+void Agent::set_report_interval(int milliseconds)
+{
+    report_interval = milliseconds;
+}
+
+void Agent::request_status()
+{
+    status_requested = true;
+}
+
+void Agent::stop_background()
+{
+    if (!background_board)
+        return;
+    MOVE result;
+    finish_ponder(&result, 0, 0);
+}
+
+void Agent::report_progress(TimePoint now)
+{
+    if (status_requested.exchange(false))
+    {
+        // stat01: time nodes ply mvleft mvtot mvname
+        int t = (int) (chrono::duration<double>(now - search_start_time).count() * 100);
+        cout << "stat01: " << t << " " << nodes << " " << report_depth << " "
+            << root_moves_count - root_move_index << " " << root_moves_count;
+        if (root_move != 0)
+            cout << " " << move_string(root_move);
+        cout << endl;
+    }
+
+    if (analyzing && now >= next_report)
+    {
+        if (report_depth > 0)
+            output_thinking(report_depth, report_score, &report_pv);
+        next_report = now + chrono::milliseconds(report_interval);
+    }
+}
+
 void Agent::output_thinking(int ply, int score, PV *pv)
 {
-    int t = (int) ((double) (clock() - search_start_time) / (double) CLOCKS_PER_SEC * 100);
+    int t = (int) (chrono::duration<double>(chrono::steady_clock::now() - search_start_time).count() * 100);
     string sign;
     if (score > 0)
         sign = "+";
@@ -115,14 +354,17 @@ void Agent::output_thinking(int ply, int score, PV *pv)
     cout << endl;
 }
 
-int Agent::id(Board &board, int side, MOVE *result, clock_t deadline, int *depth)
+int Agent::id(Board &board, int side, MOVE *result, TimePoint deadline, int *depth)
 {
     int ret = 0;
     memset(move_score, 0, sizeof(move_score));
     memset(killer, 0, sizeof(killer));
 
     *result = 0;
-    for (int level = 1; level <= *depth; ++level)
+    stretch = 0;
+    MOVE last_move = 0;
+    int first_level = parallel_mode == LAZY_SMP ? 1 + (thread_index & 1) : 1;
+    for (int level = first_level; level <= *depth; ++level)
     {
         PV pv;
         pv.count = 0;
@@ -135,6 +377,8 @@ int Agent::id(Board &board, int side, MOVE *result, clock_t deadline, int *depth
         {
             ret = t;
             *result = current_move;
+            if (thread_index == 0 && pv.count > 0 && pv.moves[0] == current_move)
+                last_pv = pv;
         }
 
         if (aborted)
@@ -142,30 +386,59 @@ int Agent::id(Board &board, int side, MOVE *result, clock_t deadline, int *depth
             *depth = level - 1;
             break;
         }
+
+        // Between iterations the main thread decides whether to go on; the helpers follow its stop.
+        if (thread_index == 0)
+        {
+            if (last_move == 0)
+                stretch = 1;
+            else
+                stretch = current_move != last_move ? min(stretch * 1.5, MAX_STRETCH) : max(stretch * 0.8, MIN_STRETCH);
+            last_move = current_move;
+
+            if (soft_limit_reached())
+            {
+                *depth = level;
+                break;
+            }
+        }
     }
     return ret;
 }
 
-int Agent::search_root(Board &board, int side, MOVE *result, int depth, clock_t deadline,
+bool Agent::soft_limit_reached()
+{
+    // A forced move needs no search, except in analysis
+    double factor = stretch;
+    if (factor == 0)
+        return false;
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - search_start_time).count();
+    return (root_moves_count == 1 && !analyzing) || elapsed >= soft_limit * factor;
+}
+
+int Agent::search_root(Board &board, int side, MOVE *result, int depth, TimePoint deadline,
         MOVE first_move, PV *pv, bool *aborted)
 {
     uint64_t my_hash = board.hash_code(side);
     bool store_tt = true;
 
-    MoveList ml(&board, side, first_move, move_score, 0, 0);
+    MoveList ml(&board, side, board.in_check(side), first_move, move_score, 0, 0);
 
     *aborted = false;
-    MOVE move, best_move = 0;
+    MOVE best_move = 0;
+    FULL_MOVE move;
     int ans = ABORTED;
 
     for (int i = 0; ans < INF && (move = ml.next_move()); ++i)
     {
+        root_move_index = i + 1;
+        root_move = short_move(move);
+
         MoveType mt;
-        if (!board.move(move, &mt))
-            continue;
+        board.move(short_move(move), &mt);
 
         PV newPV;
-        newPV.moves[0] = move;
+        newPV.moves[0] = short_move(move);
         newPV.count = 1;
 
         int t;
@@ -197,7 +470,7 @@ int Agent::search_root(Board &board, int side, MOVE *result, int depth, clock_t
 
         if (t > ans)
         {
-            best_move = move;
+            best_move = short_move(move);
             ans = t;
             store_tt = propagated_store;
             if (pv)
@@ -206,7 +479,14 @@ int Agent::search_root(Board &board, int side, MOVE *result, int depth, clock_t
                 catPV(pv, &newPV);
             }
 
-            output_thinking(depth, ans, pv);
+            if (thread_index == 0 && pv)
+            {
+                output_thinking(depth, ans, pv);
+                report_depth = depth;
+                report_score = ans;
+                report_pv = *pv;
+                next_report = chrono::steady_clock::now() + chrono::milliseconds(report_interval);
+            }
         }
     }
 
@@ -227,13 +507,13 @@ int Agent::search_root(Board &board, int side, MOVE *result, int depth, clock_t
 
 // if return value >= beta, it is a lower bound; if return value <= alpha, it is an upper bound
 int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha, int beta,
-        int ply, clock_t deadline, bool nullable, POSITION last_square,
+        int ply, TimePoint deadline, bool nullable, POSITION last_square,
         bool isPV, PV *pv, bool *store_tt)
 {
     if (depth == 0)
     {
         ++nodes;
-        return quiescence(board, side, alpha, beta, board.in_check(side), last_square, store_tt);
+        return quiescence(board, side, alpha, beta, board.in_check(side), last_square, CHECKS_IN_QUIESCENCE, store_tt);
     }
 
     uint64_t my_hash = board.hash_code(side);
@@ -242,17 +522,13 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
 
     int his_score, his_exact = 0, his_depth = 0;
     MOVE his_move = 0;
-    MoveType mt;
     if (USE_TRANS_TABLE && trans.get(board.hash_code(side), &his_score, &his_exact, &his_move, &his_depth)
-            && (his_move == 0 || board.checked_move(side, his_move, &mt)))
+            && (his_move == 0 || (board.is_pseudo_legal(side, his_move) && board.is_legal_move(side, his_move))))
     {
-        if (his_move != 0)
-            board.unmove();
-
-        if (his_depth >= depth && (his_move == 0 || mt != PERPETUAL_CHECK_OR_CHASE) &&
+        if (his_depth >= depth &&
                 (his_exact == Transposition::EXACT || (his_exact == Transposition::UPPER && his_score <= alpha)
                  || (his_exact == Transposition::LOWER && his_score >= beta))
-                && (nullable || his_move != 0))
+                && (nullable || his_move != 0) && (his_move == 0 || !is_perpetual(board, his_move)))
         {
             if (result)
                 *result = his_move;
@@ -263,13 +539,19 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
             nullable = false;
     }
 
-    if (nodes % CHECK_TIME_NODES == 0 && clock() >= deadline)
-        return ABORTED;
+    if (nodes % CHECK_TIME_NODES == 0)
+    {
+        TimePoint now = chrono::steady_clock::now();
+        if (stop || now >= deadline)
+            return ABORTED;
+        if (thread_index == 0)
+            report_progress(now);
+    }
 
     ++nodes;
 
     int ans = -INF;
-    MOVE best_move = 0;
+    FULL_MOVE best_move = 0;
     MOVE searched_moves[120];
     int searched_moves_count = 0;
     bool aborted = false, propagated_store;
@@ -297,19 +579,49 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
                     false, last_square, isPV, NULL, &propagated_store);
 
         int original_pv_count = pv ? pv->count : 0;
-        MoveList ml(&board, side, his_move, move_score, killer[ply][0], killer[ply][1]);
-        MOVE move;
-        for (int i = 0; ans < beta && (move = ml.next_move()); ++i)
+        MoveList ml(&board, side, board.in_check(side), his_move, move_score, killer[ply][0], killer[ply][1]);
+        FULL_MOVE move;
+        bool deferring = is_deferring() && depth >= ABDADA_DEPTH;
+        FULL_MOVE deferred[120];
+        int deferred_count = 0, deferred_index = 0;
+        for (int i = 0; ans < beta; ++i)
         {
+            // Deferred moves are searched once the move list is used up, without deferring again
+            bool was_deferred = false;
+            if (!(move = ml.next_move()))
+            {
+                if (deferred_index == deferred_count)
+                    break;
+                move = deferred[deferred_index++];
+                was_deferred = true;
+            }
+
+            uint64_t move_key = searching_key(my_hash, short_move(move));
+            bool marked = false;
+            if (deferring)
+            {
+                atomic<uint64_t> &entry = searching_entry(move_key);
+                uint64_t current = entry.load(memory_order_relaxed);
+                if (i > 0 && !was_deferred && current == move_key)
+                {
+                    deferred[deferred_count++] = move;
+                    --i;
+                    continue;
+                }
+                marked = current == 0 && entry.compare_exchange_strong(current, move_key, memory_order_relaxed);
+            }
+
+            // Only moves that may be reduced need to know whether they check
+            bool may_reduce = USE_LMR && !isPV && depth > LMR_DEPTH && i >= LMR_NODES
+                && ml.remaining_moves() && !board.gives_check(short_move(move));
             MoveType mt;
-            if (!board.move(move, &mt))
-                continue;
+            board.move(short_move(move), &mt);
 
             PV newPV;
-            newPV.moves[0] = move;
+            newPV.moves[0] = short_move(move);
             newPV.count = 1;
 
-            searched_moves[searched_moves_count++] = move;
+            searched_moves[searched_moves_count++] = short_move(move);
 
             int t;
             if (!special_move_type(mt, &t, &propagated_store))
@@ -324,8 +636,7 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
                 {
                     t = current_alpha + 1;
 
-                    if (USE_LMR && !isPV && depth > LMR_DEPTH && i >= LMR_NODES
-                            && ml.remaining_moves())
+                    if (may_reduce)
                     {
                         t = -alpha_beta(board, 1 - side, NULL, depth - 2, -current_alpha - 1,
                                 -current_alpha, ply + 1, deadline, true, dst, false, NULL, &propagated_store);
@@ -341,6 +652,8 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
             }
 
             board.unmove();
+            if (marked)
+                searching_entry(move_key).store(0, memory_order_relaxed);
 
             if (t == -ABORTED)
             {
@@ -362,10 +675,10 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
 
             if (t >= beta)
             {
-                if (USE_KILLER && killer[ply][0] != move)
+                if (USE_KILLER && killer[ply][0] != short_move(move))
                 {
                     killer[ply][1] = killer[ply][0];
-                    killer[ply][0] = move;
+                    killer[ply][0] = short_move(move);
                 }
                 break;
             }
@@ -383,14 +696,14 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
             e = Transposition::UPPER;
         else if (ans >= beta)
             e = Transposition::LOWER;
-        trans.put(my_hash, ans, e, best_move, depth);
+        trans.put(my_hash, ans, e, short_move(best_move), depth);
     }
 
-    if (ans >= beta && best_move != 0 && !board.is_capture(best_move))
-        update_history(depth, best_move, searched_moves, searched_moves_count);
+    if (ans >= beta && best_move != 0 && captured_piece(best_move) == 0)
+        update_history(depth, short_move(best_move), searched_moves, searched_moves_count);
 
     if (result)
-        *result = best_move;
+        *result = short_move(best_move);
 
     return ans;
 }
@@ -398,27 +711,26 @@ int Agent::alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha
 int Agent::quiescence(Board &board, int side, int alpha, int beta, POSITION last_square)
 {
     bool store_tt;
-    return quiescence(board, side, alpha, beta, board.in_check(side), last_square, &store_tt);
+    board.mark_history();
+    int ret = quiescence(board, side, alpha, beta, board.in_check(side), last_square, CHECKS_IN_QUIESCENCE, &store_tt);
+    board.clear_history_mark();
+    return ret;
 }
 
 int Agent::quiescence(Board &board, int side, int alpha, int beta,
-        bool in_check, POSITION last_square, bool *store_tt)
+        bool in_check, POSITION last_square, bool checks, bool *store_tt)
 {
     *store_tt = true;
 
     uint64_t my_hash = board.hash_code(side);
     int his_score, his_exact = 0, his_depth = 0;
     MOVE his_move = 0;
-    MoveType mt;
     if (USE_TRANS_TABLE && trans.get(board.hash_code(side), &his_score, &his_exact, &his_move, &his_depth)
-            && (his_move == 0 || board.checked_move(side, his_move, &mt)))
+            && (his_move == 0 || (board.is_pseudo_legal(side, his_move) && board.is_legal_move(side, his_move))))
     {
-        if (his_move != 0)
-            board.unmove();
-
-        if ((his_move == 0 || mt != PERPETUAL_CHECK_OR_CHASE) &&
-                (his_exact == Transposition::EXACT || (his_exact == Transposition::UPPER && his_score <= alpha)
-                 || (his_exact == Transposition::LOWER && his_score >= beta)))
+        if ((his_exact == Transposition::EXACT || (his_exact == Transposition::UPPER && his_score <= alpha)
+                 || (his_exact == Transposition::LOWER && his_score >= beta))
+                && (his_move == 0 || !is_perpetual(board, his_move)))
             return his_score;
     }
 
@@ -430,9 +742,12 @@ int Agent::quiescence(Board &board, int side, int alpha, int beta,
 
     if (ans < beta)
     {
-        MOVE moves[120];
-        int capture_scores[120], moves_count = 0;
-        board.generate_moves(side, moves, capture_scores, &moves_count);
+        FULL_MOVE moves[120];
+        int moves_count = 0;
+        if (in_check)
+            board.generate_evasions(side, moves, &moves_count);
+        else
+            board.generate_captures(side, moves, &moves_count);
 
         if (!in_check)
         {
@@ -440,50 +755,44 @@ int Agent::quiescence(Board &board, int side, int alpha, int beta,
             for (int i = 0; i < moves_count; ++i)
             {
                 if (move_dst(moves[i]) == last_square)
-                    capture_scores[i] = max(capture_scores[i], Board::KING_CAPTURE_VALUE - 1);
-                if (capture_scores[i] > Board::NON_CAPTURE
-                        && is_winning_capture(&board, moves[i], capture_scores[i], side))
+                    moves[i] = with_order_score(moves[i], max(order_score(moves[i]), Board::KING_CAPTURE_VALUE - 1));
+                if (captured_piece(moves[i]) != 0 && is_winning_capture(&board, moves[i], side))
                 {
-                    MOVE tm = moves[c];
+                    FULL_MOVE tm = moves[c];
                     moves[c] = moves[i];
                     moves[i] = tm;
-                    int t = capture_scores[c];
-                    capture_scores[c] = capture_scores[i];
-                    capture_scores[i] = t;
 
                     ++c;
                 }
             }
-            order_moves(moves, capture_scores, c, c);
-            if (!CHECKS_IN_QUIESCENCE)
-                moves_count = c;
+            order_moves(moves, c, c);
+            moves_count = c;
+
+            if (checks)
+            {
+                int checks_count;
+                board.generate_quiet_checks(side, moves + c, &checks_count);
+                moves_count += checks_count;
+            }
         }
 
         for (int i = 0; ans < beta && i < moves_count; ++i)
         {
-            MoveType mt;
-            if (!board.move(moves[i], &mt))
+            // Quiet moves are only searched when they evade or give check
+            bool next_in_check = board.gives_check(short_move(moves[i]));
+            if (!in_check && captured_piece(moves[i]) == 0 && !next_in_check)
                 continue;
 
+            MoveType mt;
+            board.move(short_move(moves[i]), &mt);
+
             int t;
             bool propagated_store;
             if (!special_move_type(mt, &t, &propagated_store))
             {
-                t = -INF;
-                // it is faster to refute suicide here
-                if (in_check && board.in_check(side))
-                    propagated_store = true;
-                else
-                {
-                    bool next_in_check = board.in_check(1 - side);
-
-                    if (in_check || capture_scores[i] > Board::NON_CAPTURE || next_in_check)
-                    {
-                        int current_alpha = max(alpha, ans);
-                        t = -quiescence(board, 1 - side, -beta, -current_alpha,
-                                next_in_check, move_dst(moves[i]), &propagated_store);
-                    }
-                }
+                int current_alpha = max(alpha, ans);
+                t = -quiescence(board, 1 - side, -beta, -current_alpha,
+                        next_in_check, move_dst(moves[i]), false, &propagated_store);
             }
 
             if (t > ans)
@@ -1,6 +1,11 @@
 #pragma once
 
-#include <ctime>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "common.h"
 #include "board.h"
@@ -12,10 +17,70 @@ class Agent
 {
     public:
         Agent();
-        int search(Board &board, int side, MOVE *result, int time_limit, int depth);
+        ~Agent();
+        // Starts no new iteration after soft_limit milliseconds, stretched while the best move
+        // keeps changing and shrunk while it holds, and stops at hard_limit
+        int search(Board &board, int side, MOVE *result, int soft_limit, int hard_limit, int depth);
+        // Threads used by search, this one included. The others each search their own copy of
+        // the board with their own killer and history tables, sharing the transposition table.
+        void set_threads(int threads);
+
+        // How the threads share the search. With LAZY_SMP they only meet in the transposition
+        // table. With ABDADA they all search the same depths, and a thread defers a move that
+        // another thread is already searching until it has tried its other moves.
+        enum ParallelMode
+        {
+            LAZY_SMP,
+            ABDADA
+        };
+        void set_parallel_mode(ParallelMode mode);
+
+        // Pondering: after a search, the position after the reply its PV expects is searched in
+        // the background until the opponent moves. start_ponder takes the board after our move,
+        // with the opponent to move, and returns false when there is no reply to ponder on.
+        // On a hit, finish_ponder finishes the search as search would with soft_limit and
+        // hard_limit, counting the time already pondered against soft_limit, and returns its
+        // result; on anything else, stop_background stops it. Both keep the transposition table.
+        bool start_ponder(Board &board, int side);
+        int finish_ponder(MOVE *result, int soft_limit, int hard_limit);
+        inline bool is_pondering()
+        {
+            return background_board != NULL && ponder_expected != 0;
+        }
+        inline MOVE ponder_reply()
+        {
+            return ponder_expected;
+        }
+
+        // Analysis: searches a copy of board in the background until stop_background, printing
+        // the PV whenever it changes and, between changes, every report_interval milliseconds
+        void start_analysis(Board &board, int side);
+        inline bool is_analyzing()
+        {
+            return background_board != NULL && analyzing;
+        }
+        void set_report_interval(int milliseconds);
+        // Has the search print an xboard stat01 line at its next time check
+        void request_status();
+
+        void stop_background();
+
         int quiescence(Board &board, int side, int alpha, int beta, POSITION last_square = INVALID_POSITION);
 
     protected:
+        Agent(const Agent &);
+        Agent &operator=(const Agent &);
+        // A helper for owner's search, sharing its transposition table and stop flag
+        Agent(Agent *owner, int thread_index);
+
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        // search without clearing stop first or setting soft_limit, for searches another thread
+        // may stop or give a new soft limit
+        int run_search(Board &board, int side, MOVE *result, int hard_limit, int depth);
+        // Runs run_search on background_board in a thread of its own
+        void start_background(int side);
+
         static const bool USE_NULL_MOVE = true;
         static const bool USE_TRANS_TABLE = true;
         static const bool USE_IID = true;
@@ -24,34 +89,99 @@ class Agent
         static const bool USE_LMR = true;
         static const int LMR_NODES = 2, LMR_DEPTH = 3;
 
-        static const bool CHECKS_IN_QUIESCENCE = false;
+        // Search quiet checks at the first ply of quiescence
+        static const bool CHECKS_IN_QUIESCENCE = true;
         static const int CHECK_TIME_NODES = 32768;
 
         static const int ABORTED = -INF - 1;
 
-        int select_best_move(int *scores, int moves_count);
-        void order_moves(MOVE *moves, int *scores, int moves_count, int order_count);
+        int select_best_move(FULL_MOVE *moves, int moves_count);
+        void order_moves(FULL_MOVE *moves, int moves_count, int order_count);
 
-        int id(Board &board, int side, MOVE *result, clock_t deadline, int *depth);
-        int search_root(Board &board, int side, MOVE *result, int depth, clock_t deadline,
+        int id(Board &board, int side, MOVE *result, TimePoint deadline, int *depth);
+        int search_root(Board &board, int side, MOVE *result, int depth, TimePoint deadline,
                 MOVE first_move, PV *pv, bool *aborted);
         int alpha_beta(Board &board, int side, MOVE *result, int depth, int alpha, int beta, int ply,
-                clock_t deadline, bool nullable, POSITION last_square, bool isPV, PV *pv, bool *store_tt);
+                TimePoint deadline, bool nullable, POSITION last_square, bool isPV, PV *pv, bool *store_tt);
 
-        int quiescence(Board &board, int side, int alpha, int beta, bool in_check, POSITION last_square, bool *store_tt);
+        int quiescence(Board &board, int side, int alpha, int beta, bool in_check, POSITION last_square,
+                bool checks, bool *store_tt);
 
-        int nodes;
+        uint64_t nodes;
         int move_score[1 << 16];
         int killer[MAX_DEPTH][2];
 
-        double ebf(int nodes, int depth);
+        double ebf(uint64_t nodes, int depth);
 
         bool special_move_type(MoveType mt, int *score, bool *store_tt);
-
-        Transposition trans;
-
-        clock_t search_start_time;
+        // Whether making move would be perpetual check or chase. Hash moves are only made to
+        // ask this when their score is about to be returned.
+        bool is_perpetual(Board &board, MOVE move);
+
+        Transposition *own_trans;
+        Transposition &trans;
+
+        // Helpers run id with the same deadline until the main search is done and sets stop.
+        // With LAZY_SMP odd-numbered ones start one level deeper, so the threads spread over
+        // two depths.
+        int thread_index;
+        std::vector<Agent *> helpers;
+        std::atomic<bool> own_stop, &stop;
+        ParallelMode parallel_mode;
+
+        // ABDADA: keys of the moves being searched, by position and move, in a small table
+        // shared by all threads. Moves are only deferred from ABDADA_DEPTH up, after the
+        // first move of a node has been searched. A thread only takes a free entry, and only
+        // the thread that took it frees it, so a move stays marked while its first searcher
+        // is still on it.
+        static const int ABDADA_DEPTH = 3, SEARCHING_BITS = 15;
+        std::atomic<uint64_t> *own_searching, *searching;
+        inline bool is_deferring()
+        {
+            return parallel_mode == ABDADA && (thread_index != 0 || !helpers.empty());
+        }
+        static inline uint64_t searching_key(uint64_t hash, MOVE move)
+        {
+            return hash ^ ((uint64_t) move * 0x9e3779b97f4a7c15ULL);
+        }
+        inline std::atomic<uint64_t> &searching_entry(uint64_t key)
+        {
+            return searching[key & ((1 << SEARCHING_BITS) - 1)];
+        }
+
+        // The main thread's PV from the last completed iteration, for the reply to ponder on
+        PV last_pv;
+
+        Board *background_board;
+        MOVE ponder_expected, background_result;
+        int background_score;
+        bool background_done, analyzing;
+        std::thread background_thread;
+        std::mutex background_mutex;
+        std::condition_variable background_finished;
+        static const int BACKGROUND_TIME_LIMIT = 10 * 3600 * 1000;
+
+        TimePoint search_start_time;
+        // Both are changed by finish_ponder while the background search runs. stretch is the
+        // factor the main thread's soft limit is stretched or shrunk by, 0 until its first
+        // iteration completes.
+        std::atomic<int> soft_limit;
+        std::atomic<double> stretch;
+        // Bounds on stretch
+        static constexpr double MIN_STRETCH = 0.5, MAX_STRETCH = 3;
+        // Whether the main thread should start no new iteration
+        bool soft_limit_reached();
         void output_thinking(int ply, int score, PV *pv);
 
+        // The main thread's latest thinking line and root move, repeated or summed up in
+        // analysis reports
+        int report_depth, report_score, report_interval;
+        PV report_pv;
+        TimePoint next_report;
+        int root_moves_count, root_move_index;
+        MOVE root_move;
+        std::atomic<bool> status_requested;
+        void report_progress(TimePoint now);
+
         void update_history(int depth, MOVE best_move, MOVE *searched_moves, int count);
 };
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "move.h"
+
+// A set of board squares. Square index is rank * 9 + file; ranks 0-4 are
+// kept in the low word and ranks 5-9 in the high word, 45 bits each, so a
+// rank never straddles the two words.
+class Bitboard
+{
+    public:
+        uint64_t lo, hi;
+
+        static const int SQUARES = 90, HALF = 45;
+        static const uint64_t HALF_MASK = (((uint64_t) 1) << HALF) - 1;
+
+        constexpr Bitboard() : lo(0), hi(0) {}
+        constexpr Bitboard(uint64_t l, uint64_t h) : lo(l), hi(h) {}
+
+        static constexpr Bitboard square(int sq)
+        {
+            if (sq < HALF)
+                return Bitboard(((uint64_t) 1) << sq, 0);
+            else
+                return Bitboard(0, ((uint64_t) 1) << (sq - HALF));
+        }
+
+        constexpr bool empty() const
+        {
+            return (lo | hi) == 0;
+        }
+
+        constexpr bool test(int sq) const
+        {
+            if (sq < HALF)
+                return (lo >> sq) & 1;
+            else
+                return (hi >> (sq - HALF)) & 1;
+        }
+
+        constexpr void set(int sq)
+        {
+            if (sq < HALF)
+                lo |= ((uint64_t) 1) << sq;
+            else
+                hi |= ((uint64_t) 1) << (sq - HALF);
+        }
+
+        constexpr void clear(int sq)
+        {
+            if (sq < HALF)
+                lo &= ~(((uint64_t) 1) << sq);
+            else
+                hi &= ~(((uint64_t) 1) << (sq - HALF));
+        }
+
+        constexpr void toggle(int sq)
+        {
+            if (sq < HALF)
+                lo ^= ((uint64_t) 1) << sq;
+            else
+                hi ^= ((uint64_t) 1) << (sq - HALF);
+        }
+
+        // Removes the lowest square from the set and returns it. The set must not be empty.
+        constexpr int pop()
+        {
+            int sq = 0;
+            if (lo)
+            {
+                sq = __builtin_ctzll(lo);
+                lo &= lo - 1;
+            }
+            else
+            {
+                sq = HALF + __builtin_ctzll(hi);
+                hi &= hi - 1;
+            }
+            return sq;
+        }
+
+        constexpr int count() const
+        {
+            return __builtin_popcountll(lo) + __builtin_popcountll(hi);
+        }
+
+        constexpr Bitboard operator&(const Bitboard &b) const { return Bitboard(lo & b.lo, hi & b.hi); }
+        constexpr Bitboard operator|(const Bitboard &b) const { return Bitboard(lo | b.lo, hi | b.hi); }
+        constexpr Bitboard operator^(const Bitboard &b) const { return Bitboard(lo ^ b.lo, hi ^ b.hi); }
+        constexpr Bitboard operator~() const { return Bitboard(~lo & HALF_MASK, ~hi & HALF_MASK); }
+        constexpr Bitboard &operator&=(const Bitboard &b) { lo &= b.lo; hi &= b.hi; return *this; }
+        constexpr Bitboard &operator|=(const Bitboard &b) { lo |= b.lo; hi |= b.hi; return *this; }
+        constexpr Bitboard &operator^=(const Bitboard &b) { lo ^= b.lo; hi ^= b.hi; return *this; }
+        constexpr bool operator==(const Bitboard &b) const { return lo == b.lo && hi == b.hi; }
+        constexpr bool operator!=(const Bitboard &b) const { return lo != b.lo || hi != b.hi; }
+};
+
+constexpr int position_square(POSITION p)
+{
+    return position_rank(p) * 9 + position_file(p);
+}
+
+constexpr POSITION square_position(int sq)
+{
+    return make_position(sq / 9, sq % 9);
+}
@@ -1,13 +1,52 @@
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <cassert>
 #include "board.h"
 #include "rc4.h"
+#include "tables.h"
 
 using namespace std;
 
+static constexpr BoardTables tables = make_board_tables();
+
+static inline POSITION line_position(int i, int j, int k)
+{
+    return k < 16 ? make_position(i, k) : make_position(k - 16, j);
+}
+
+static inline Bitboard rank_squares(int i, int mask)
+{
+    uint64_t bits = ((uint64_t) mask) << ((i % 5) * 9);
+    if (i < 5)
+        return Bitboard(bits, 0);
+    else
+        return Bitboard(0, bits);
+}
+
+// Spreads the 10-bit file mask onto the board: multiplying by 0x0101010101 copies bit k of
+// each 5-bit half to bit 9k, among other places that the 0x1008040201 mask drops.
+static inline Bitboard file_squares(int j, int mask)
+{
+    return Bitboard(((((uint64_t) (mask & 31)) * 0x0101010101ULL) & 0x1008040201ULL) << j,
+            ((((uint64_t) (mask >> 5)) * 0x0101010101ULL) & 0x1008040201ULL) << j);
+}
+
+// The inverses: the occupancy masks of rank i and file j in a bitboard. Multiplying the file's
+// bits 9k by 0x0101010101 gathers them at bits 32 + k.
+static inline int rank_mask(const Bitboard &b, int i)
+{
+    return ((i < 5 ? b.lo : b.hi) >> ((i % 5) * 9)) & 0x1ff;
+}
+
+static inline int file_mask(const Bitboard &b, int j)
+{
+    return (((((b.lo >> j) & 0x1008040201ULL) * 0x0101010101ULL) >> 32) & 31)
+        | (((((b.hi >> j) & 0x1008040201ULL) * 0x0101010101ULL) >> 32) & 31) << 5;
+}
+
 Board::Board(string fen)
     : hash_side(rc4_uint64[H * W * 16])
-    , history_positions(8)
 {
     set(fen);
 }
@@ -27,8 +66,21 @@ void Board::set(string fen)
     hash = 0;
     current_static_value = 0;
 
+    occupancy[0] = occupancy[1] = Bitboard();
+    for (int i = 0; i < 16; ++i)
+        piece_boards[i] = Bitboard();
+    memset(rank_occupancy, 0, sizeof(rank_occupancy));
+    memset(file_occupancy, 0, sizeof(file_occupancy));
+
+    for (int p = 0; p < BOARD_SIZE; ++p)
+    {
+        board[p].index = 0;
+        board[p].piece = OFF_BOARD;
+    }
+
+    // Stops at the end of the board field, so a full FEN with the side to move can be passed
     int i = 0, j = 0;
-    for (size_t k = 0; k < fen.length(); ++k)
+    for (size_t k = 0; k < fen.length() && fen[k] != ' '; ++k)
     {
         if (fen[k] == '/')
         {
@@ -40,8 +92,7 @@ void Board::set(string fen)
             int count = fen[k] - '0';
             while (count > 0)
             {
-                board[i][j].index = 0;
-                board[i][j].piece = 0;
+                board[make_position(i, j)].piece = 0;
                 ++j;
                 --count;
             }
@@ -52,10 +103,11 @@ void Board::set(string fen)
             int index = start_position[piece];
             ++start_position[piece];
 
-            board[i][j].index = index;
-            board[i][j].piece = piece;
+            board[make_position(i, j)].index = index;
+            board[make_position(i, j)].piece = piece;
             pieces[index].position = make_position(i, j);
             pieces[index].piece = piece;
+            toggle_piece(piece, i * W + j);
 
             hash ^= get_hash(i, j, piece);
             current_static_value += static_values[piece][i][j];
@@ -64,9 +116,12 @@ void Board::set(string fen)
         }
     }
 
-    history.clear();
-    history.reserve(128);
-    history_positions.clear();
+    history_count = 0;
+    history_mark = MAX_HISTORY;
+    states.clear();
+    check_info_valid = false;
+    memset(repetition_filter, 0, sizeof(repetition_filter));
+    ++repetition_filter_count();
 }
 
 void Board::print()
@@ -77,10 +132,11 @@ void Board::print()
         cout << H - 1 - i << "  ";
         for (int j = 0; j < W; ++j)
         {
-            if (board[i][j].piece == 0)
+            PIECE piece = board[make_position(i, j)].piece;
+            if (piece == 0)
                 cout << '.';
             else
-                cout << piece_letter(board[i][j].piece);
+                cout << piece_letter(piece);
             cout << " ";
         }
         cout << " " << H - 1 - i << endl;
@@ -95,6 +151,24 @@ uint64_t Board::get_hash(int rank, int col, PIECE piece)
     return rc4_uint64[rank * W * 16 + col * 16 + piece];
 }
 
+void BoardState::toggle_piece(PIECE piece, int sq)
+{
+    piece_boards[piece].toggle(sq);
+    occupancy[piece_side(piece)].toggle(sq);
+    rank_occupancy[sq / Board::W] ^= 1 << (sq % Board::W);
+    file_occupancy[sq % Board::W] ^= 1 << (sq / Board::W);
+}
+
+void BoardState::shift_piece(POSITION from, POSITION to)
+{
+    BoardEntry entry = board[from];
+    toggle_piece(entry.piece, position_square(from));
+    toggle_piece(entry.piece, position_square(to));
+    board[to] = entry;
+    board[from].piece = 0;
+    pieces[entry.index].position = to;
+}
+
 uint64_t Board::hash_code(int side)
 {
     if (side == 0)
@@ -105,86 +179,104 @@ uint64_t Board::hash_code(int side)
 
 bool Board::checked_move(int side, MOVE move, MoveType *mt)
 {
-    int src_i = position_rank(move_src(move)),
-        src_j = position_file(move_src(move)),
-        dst_i = position_rank(move_dst(move)),
-        dst_j = position_file(move_dst(move));
-    if (!(is_on_board(src_i, src_j) && is_on_board(dst_i, dst_j)))
+    if (!is_pseudo_legal(side, move))
         return false;
-    if (!(is_on_board(src_i, src_j) && is_on_board(dst_i, dst_j)))
-    if (board[src_i][src_j].piece == 0)
-        return false;
-    if (src_i == dst_i && src_j == dst_j)
+
+    this->move(move, mt);
+    if (in_check(side))
+    {
+        unmove();
         return false;
+    }
+
+    return true;
+}
 
-    PIECE src = board[src_i][src_j].piece;
-    if (piece_side(src) != side)
+bool Board::is_pseudo_legal(int side, MOVE move)
+{
+    POSITION src = move_src(move), dst = move_dst(move);
+    PIECE piece = board[src].piece, captured = board[dst].piece;
+    if (piece == OFF_BOARD || captured == OFF_BOARD || piece == 0 || src == dst)
+        return false;
+    if (piece_side(piece) != side || (captured != 0 && piece_side(captured) == side))
         return false;
-    int index = board[src_i][src_j].index;
 
-    MOVE moves[120];
-    int scores[120], count = 0;
-    switch (piece_type(src))
+    int si = position_rank(src), sj = position_file(src), di = position_rank(dst), dj = position_file(dst);
+    int src_sq = si * W + sj, dst_sq = di * W + dj;
+    switch (piece_type(piece))
     {
         case PIECE_K:
-            generate_king_moves(index, moves, scores, &count);
-            break;
+            return tables.king_masks[src_sq].test(dst_sq);
 
         case PIECE_A:
-            generate_advisor_moves(index, moves, scores, &count);
-            break;
+            return tables.advisor_masks[src_sq].test(dst_sq);
 
         case PIECE_E:
-            generate_elephant_moves(index, moves, scores, &count);
-            break;
+            for (const POSITION *step = tables.elephant_steps[src_sq][0]; *step != INVALID_POSITION; step += 2)
+                if (step[0] == dst)
+                    return board[step[1]].piece == 0;
+            return false;
 
         case PIECE_H:
-            generate_horse_moves(index, moves, scores, &count);
-            break;
-
-        case PIECE_R:
-            generate_rook_moves(index, moves, scores, &count);
-            break;
-
-        case PIECE_C:
-            generate_cannon_moves(index, moves, scores, &count);
-            break;
-
-        case PIECE_P:
-            generate_pawn_moves(index, moves, scores, &count);
-            break;
-
-        default:
+            for (const POSITION *step = tables.horse_steps[src_sq][0]; *step != INVALID_POSITION; step += 2)
+                if (step[0] == dst)
+                    return board[step[1]].piece == 0;
             return false;
-    }
 
-    bool hit = false;
-    for (int i = 0; !hit && i < count; ++i)
-        if (moves[i] == move)
-            hit = true;
-    if (!hit)
-        return false;
+        case PIECE_P:
+            return tables.pawn_masks[side][src_sq].test(dst_sq);
 
-    if (!this->move(move, mt))
-        return false;
+        case PIECE_R:
+        case PIECE_C:
+            {
+                const SlideEntry *entry;
+                int bit;
+                if (si == di)
+                {
+                    entry = &tables.rank_slides[sj][rank_occupancy[si]];
+                    bit = 1 << dj;
+                }
+                else if (sj == dj)
+                {
+                    entry = &tables.file_slides[si][file_occupancy[sj]];
+                    bit = 1 << di;
+                }
+                else
+                    return false;
 
-    if (in_check(side))
-    {
-        unmove();
-        return false;
+                if (captured == 0)
+                    return (entry->empty & bit) != 0;
+                else
+                    return ((piece_type(piece) == PIECE_R ? entry->first : entry->second) & bit) != 0;
+            }
     }
-
-    return true;
+    return false;
 }
 
-bool Board::move(MOVE move, MoveType *mt, bool detect_repetition)
+void Board::move(MOVE move, MoveType *mt, bool detect_repetition)
 {
     int src_i = position_rank(move_src(move)),
         src_j = position_file(move_src(move)),
         dst_i = position_rank(move_dst(move)),
         dst_j = position_file(move_dst(move));
-    BoardEntry src = board[src_i][src_j],
-               dst = board[dst_i][dst_j];
+    BoardEntry src = board[move_src(move)],
+               dst = board[move_dst(move)];
+
+    if (history_count == MAX_HISTORY)
+        compact_history();
+    if (USE_COPY_MAKE)
+        states.push_back(*this);
+
+    HistoryEntry &history_entry = history[history_count++];
+    history_entry.move = move;
+    history_entry.capture = dst;
+    history_entry.hash = hash;
+    history_entry.static_value = current_static_value;
+
+    // Checks are predicted before the move for test_for_perpetual, which works out chases
+    // only when a repetition needs them
+    history_entry.gave_check = detect_repetition && dst.piece == 0 && gives_check(move);
+    history_entry.chases_known = false;
 
     if (mt)
         *mt = REGULAR;
@@ -200,103 +292,107 @@ bool Board::move(MOVE move, MoveType *mt, bool detect_repetition)
         }
 
         pieces[dst.index].piece = 0;
+        toggle_piece(dst.piece, dst_i * W + dst_j);
         hash ^= get_hash(dst_i, dst_j, dst.piece);
         current_static_value -= static_values[dst.piece][dst_i][dst_j];
     }
 
-    board[dst_i][dst_j] = src;
+    board[move_dst(move)] = src;
     pieces[src.index].position = make_position(dst_i, dst_j);
+    toggle_piece(src.piece, src_i * W + src_j);
+    toggle_piece(src.piece, dst_i * W + dst_j);
     hash ^= get_hash(dst_i, dst_j, src.piece);
     current_static_value += static_values[src.piece][dst_i][dst_j];
 
-    board[src_i][src_j].piece = 0;
+    board[move_src(move)].piece = 0;
     hash ^= get_hash(src_i, src_j, src.piece);
     current_static_value -= static_values[src.piece][src_i][src_j];
 
-    HistoryEntry history_entry;
-    history_entry.move = move;
-    history_entry.capture = dst;
-    history_entry.perp_side = NON_PERPETUAL;
-    history.push_back(history_entry);
-
     int my_side = piece_side(src.piece);
-    int rep_count = history_positions.increment(hash_code(my_side));
-    if (king_face_to_face())
-    {
-        unmove();
-        return false;
-    }
-
-    if (rep_count > 1 && detect_repetition)
-    {
-        uint8_t perp_side = NON_PERPETUAL;
-        if (dst.piece == 0)
-        {
-            if (history.size() >= 2 && history[history.size() - 2].perp_side != NON_PERPETUAL)
-            {
-                uint8_t his_perp = history[history.size() - 2].perp_side;
-                if (his_perp == my_side)
-                {
-                    if (in_check(1 - my_side))
-                        perp_side = my_side;
-                    else
-                        perp_side = NON_PERPETUAL;
-                }
-                else
-                    perp_side = his_perp;
-            }
-            else
-                perp_side = test_for_perpetual(my_side) ? my_side : NON_PERPETUAL;
-        }
+    history_entry.side = my_side;
 
-        if (mt)
-        {
-            if (perp_side == my_side)
-                *mt = PERPETUAL_CHECK_OR_CHASE;
-            else
-                *mt = REPETITION;
-        }
-    }
+    bool maybe_repeated = true;
+    if (USE_REPETITION_FILTER)
+        maybe_repeated = ++repetition_filter_count() > 1;
 
-    return true;
+    if (mt && detect_repetition && maybe_repeated && is_repetition())
+        *mt = test_for_perpetual(my_side) ? PERPETUAL_CHECK_OR_CHASE : REPETITION;
 }
 
 void Board::unmove()
 {
-    HistoryEntry history_entry = history.back();
-    history.pop_back();
+    const HistoryEntry &history_entry = history[--history_count];
 
+    if (USE_COPY_MAKE)
+    {
+        if (USE_REPETITION_FILTER)
+            --repetition_filter_count();
+        static_cast<BoardState &>(*this) = states.back();
+        states.pop_back();
+        return;
+    }
 
     int src_i = position_rank(move_src(history_entry.move)),
         src_j = position_file(move_src(history_entry.move)),
         dst_i = position_rank(move_dst(history_entry.move)),
         dst_j = position_file(move_dst(history_entry.move));
 
-    BoardEntry src = board[dst_i][dst_j], dst = history_entry.capture;
+    BoardEntry src = board[move_dst(history_entry.move)], dst = history_entry.capture;
 
-    int my_side = piece_side(src.piece);
-    history_positions.decrement(hash_code(my_side));
+    if (USE_REPETITION_FILTER)
+        --repetition_filter_count();
 
-    board[src_i][src_j] = src;
-    pieces[src.index].position = make_position(src_i, src_j);
-    hash ^= get_hash(src_i, src_j, src.piece);
-    current_static_value += static_values[src.piece][src_i][src_j];
+    board[move_src(history_entry.move)] = src;
+    board[move_dst(history_entry.move)] = dst;
+    hash = history_entry.hash;
+    current_static_value = history_entry.static_value;
 
-    hash ^= get_hash(dst_i, dst_j, src.piece);
-    current_static_value -= static_values[src.piece][dst_i][dst_j];
-    board[dst_i][dst_j] = dst;
+    pieces[src.index].position = make_position(src_i, src_j);
+    toggle_piece(src.piece, src_i * W + src_j);
+    toggle_piece(src.piece, dst_i * W + dst_j);
     if (dst.piece != 0)
     {
         pieces[dst.index].piece = dst.piece;
-        pieces[dst.index].position = make_position(dst_i, dst_j);
-        hash ^= get_hash(dst_i, dst_j, dst.piece);
-        current_static_value += static_values[dst.piece][dst_i][dst_j];
+        toggle_piece(dst.piece, dst_i * W + dst_j);
     }
 }
 
+// Whether the position after the last move, with the same side to move, occurred since the
+// last capture. Earlier positions had more pieces on the board.
+bool Board::is_repetition()
+{
+    for (int j = history_count - 1; j >= 0 && history[j].capture.piece == 0; --j)
+        if ((history_count - j) % 2 == 0 && history[j].hash == hash)
+            return true;
+    return false;
+}
+
+void Board::compact_history()
+{
+    int drop = history_count - 1;
+    while (drop >= 0 && history[drop].capture.piece == 0)
+        --drop;
+    drop = min(max(drop + 1, history_count / 2), history_mark);
+    // A marked search would have to be longer than the whole stack
+    assert(drop > 0);
+
+    // The positions before the dropped moves leave the repetition filter; the one after the
+    // last of them stays, as the position before the new first entry
+    if (USE_REPETITION_FILTER)
+        for (int j = 0; j < drop; ++j)
+            --repetition_filter_count(history[j].hash);
+
+    memmove(history, history + drop, (history_count - drop) * sizeof(HistoryEntry));
+    if (USE_COPY_MAKE)
+        states.erase(states.begin(), states.begin() + drop);
+    history_count -= drop;
+    if (history_mark < MAX_HISTORY)
+        history_mark -= drop;
+}
+
 bool Board::checked_unmove()
 {
-    if (history.size() == 0)
+    if (history_count == 0)
         return false;
     unmove();
     return true;
@@ -304,63 +400,142 @@ bool Board::checked_unmove()
 
 bool Board::test_for_perpetual(int my_side)
 {
-    vector<HistoryEntry> saved_moves;
-    int side = my_side;
-    uint64_t rep_hash = hash_code(my_side);
-    bool success = false, other_perp = true;
-    while (!success && history.size() > 0)
+    // Go back over the moves to the position before an enemy move, with the same side to move
+    // as now, that repeats the current one
+    int start = history_count - 1;
+    for (int side = my_side; ; --start, side = 1 - side)
     {
-        HistoryEntry he = history.back();
-        POSITION pos = move_dst(he.move);
-
-        if (piece_side(board[position_rank(pos)][position_file(pos)].piece) != side)
-            break;
-        if (he.capture.piece != 0)
+        if (start < 0 || history[start].side != side || history[start].capture.piece != 0)
+            return false;
+        if (side != my_side && history[start].hash == hash)
             break;
+    }
 
-        if (!in_check(1 - side))
+    // Chases are worked out the first time a repetition needs them, on a copy of the state
+    // taken back a move at a time, and kept in the history entries
+    int first = history_count;
+    for (int j = history_count - 1; j >= start; --j)
+        if (!history[j].gave_check && !history[j].chases_known)
+            first = j;
+    if (first < history_count)
+    {
+        BoardState state = *this;
+        for (int j = history_count - 1; j >= first; --j)
         {
-            if (side == my_side)
-                break;
-            else
-                other_perp = false;
+            HistoryEntry &he = history[j];
+            POSITION src = move_src(he.move), dst = move_dst(he.move);
+            state.shift_piece(dst, src);
+            if (he.gave_check || he.chases_known)
+                continue;
+
+            int chasers[16];
+            Bitboard attacks[16];
+            int count = find_chasers(state, he.move, chasers, attacks);
+            state.shift_piece(src, dst);
+            he.chased = chased_pieces(state, he.side, chasers, attacks, count);
+            he.chases_known = true;
+            state.shift_piece(dst, src);
         }
+    }
 
-        saved_moves.push_back(he);
-        unmove();
-        side = 1 - side;
+    // Each side must check or chase the same piece on every one of its moves in the cycle
+    uint16_t targets[2] = {0xffff, 0xffff};
+    bool broken[2] = {false, false};
+    for (int j = start; j < history_count; ++j)
+    {
+        const HistoryEntry &he = history[j];
+        if (!he.gave_check && (targets[he.side] &= he.chased) == 0)
+            broken[he.side] = true;
+    }
+
+    return !broken[my_side] && broken[1 - my_side];
+}
 
-        if (hash_code(side) == rep_hash)
-            success = true;
+int Board::find_chasers(const BoardState &state, MOVE m, int *chasers, Bitboard *attacks)
+{
+    POSITION src = move_src(m), dst = move_dst(m);
+    PIECE piece = state.board[src].piece;
+    int side = piece_side(piece), enemy = 1 - side, type = piece_type(piece);
+    int si = position_rank(src), sj = position_file(src), di = position_rank(dst), dj = position_file(dst);
+    int src_sq = si * W + sj, dst_sq = di * W + dj;
+    Bitboard targets = state.occupancy[enemy] & ~state.piece_boards[make_piece(enemy, PIECE_K)];
+    Bitboard rooks = state.piece_boards[make_piece(side, PIECE_R)], cannons = state.piece_boards[make_piece(side, PIECE_C)];
+    Bitboard found;
+
+    // Each group is skipped when no enemy piece lies where it could gain an attack
+    if (type != PIECE_K && type != PIECE_P && !(tables.reach_masks[type][dst_sq] & targets).empty())
+        found.set(src_sq);
+
+    // Rooks see past the source once it empties, and cannons find a new screen or target past
+    // it, when they are the first or second piece from it along a line
+    Bitboard lines = tables.reach_masks[PIECE_R][src_sq];
+    if (!(lines & (rooks | cannons)).empty() && !(lines & targets).empty())
+    {
+        const SlideEntry &rank = tables.rank_slides[sj][state.rank_occupancy[si]], &file = tables.file_slides[si][state.file_occupancy[sj]];
+        found |= (rank_squares(si, rank.first | rank.second) | file_squares(sj, file.first | file.second)) & (rooks | cannons);
     }
 
-    while (saved_moves.size() > 0)
+    // A cannon that is the first piece from the destination gains it as a screen
+    lines = tables.reach_masks[PIECE_R][dst_sq];
+    if (!(lines & cannons).empty() && !(lines & targets).empty())
     {
-        HistoryEntry he = saved_moves.back();
-        saved_moves.pop_back();
-        move(he.move, NULL, false);
-        history[history.size() - 1].perp_side = he.perp_side;
+        const SlideEntry &rank = tables.rank_slides[dj][state.rank_occupancy[di]], &file = tables.file_slides[di][state.file_occupancy[dj]];
+        found |= (rank_squares(di, rank.first) | file_squares(dj, file.first)) & cannons;
     }
 
-    return success && !other_perp;
+    found |= tables.leg_masks[src_sq] & state.piece_boards[make_piece(side, PIECE_H)];
+    found |= tables.eye_masks[src_sq] & state.piece_boards[make_piece(side, PIECE_E)];
+
+    int count = 0;
+    while (!found.empty())
+    {
+        int index = state.board[square_position(found.pop())].index;
+        chasers[count] = index;
+        attacks[count++] = state.piece_attacks(index);
+    }
+    return count;
 }
 
-bool Board::is_capture(MOVE move, int *value)
+// A chase is a new attack by a piece other than a king or pawn on an enemy piece worth more
+// than the attacker, or on an undefended one that cannot simply take the attacker back.
+// Kings are checked rather than chased, and pawns count only once across the river.
+uint16_t Board::chased_pieces(const BoardState &state, int side, const int *chasers, const Bitboard *attacks, int count)
 {
-    int src_i = position_rank(move_src(move)),
-        src_j = position_file(move_src(move)),
-        dst_i = position_rank(move_dst(move)),
-        dst_j = position_file(move_dst(move));
-    BoardEntry src = board[src_i][src_j],
-               dst = board[dst_i][dst_j];
-    if (dst.piece != 0)
+    uint16_t chased = 0;
+    int enemy = 1 - side;
+    Bitboard occupied = state.occupancy[0] | state.occupancy[1];
+    Bitboard targets = state.occupancy[enemy] & ~state.piece_boards[make_piece(enemy, PIECE_K)];
+    for (int k = 0; k < count; ++k)
     {
-        if (value)
-            *value = capture_values[piece_type(dst.piece)] -
-                capture_values[piece_type(src.piece)];
-        return true;
+        int index = chasers[k];
+        int attacker_type = piece_type(state.pieces[index].piece);
+        POSITION attacker = state.pieces[index].position;
+        Bitboard gained = state.piece_attacks(index) & ~attacks[k] & targets;
+        while (!gained.empty())
+        {
+            int sq = gained.pop();
+            POSITION target = square_position(sq);
+            int target_type = piece_type(state.board[target].piece);
+            if (target_type == PIECE_P && (enemy == 0 ? sq / W <= 4 : sq / W >= 5))
+                continue;
+
+            bool chase = capture_values[target_type] > capture_values[attacker_type]
+                || (state.attackers_to(target, enemy, occupied).empty()
+                        && !(capture_values[target_type] == capture_values[attacker_type]
+                            && state.attackers_to(attacker, enemy, occupied).test(sq)));
+            if (chase)
+                chased |= 1 << (state.board[target].index & 15);
+        }
     }
-    return false;
+    return chased;
+}
+
+FULL_MOVE Board::full_move(MOVE move)
+{
+    FULL_MOVE ret;
+    int count = 0;
+    add_move(&ret, &count, move_src(move), move_dst(move), board[move_src(move)].piece, board[move_dst(move)].piece);
+    return ret;
 }
 
 POSITION Board::king_position(int side)
@@ -542,237 +717,30 @@ int Board::static_value(int side)
         return -current_static_value;
 }
 
-bool Board::is_valid_position(PIECE piece, int i, int j)
-{
-    return (static_values[piece][i][j] != 0);
-}
-
-bool Board::is_on_board(int i, int j)
+void Board::add_move(FULL_MOVE *moves, int *moves_count, POSITION src, POSITION dst, PIECE piece, PIECE captured)
 {
-    return (i >= 0 && i < H && j >= 0 && j < W);
+    int capture_score = NON_CAPTURE;
+    if (captured != 0)
+        capture_score = capture_values[piece_type(captured)] * 8 - capture_values[piece_type(piece)];
+    moves[(*moves_count)++] = make_full_move(make_move(src, dst), piece, captured, capture_score);
 }
 
-bool Board::is_in_palace(int side, int i, int j)
+void Board::generate_moves(int side, FULL_MOVE *moves, int *moves_count)
 {
-    if (side == 0)
-        return (i >= 0 && i <= 2 && j >= 3 && j <= 5);
-    else
-        return (i >= 7 && i <= 9 && j >= 3 && j <= 5);
+    generate(side, GEN_ALL, moves, moves_count);
 }
 
-bool Board::is_in_half(int side, int i, int j)
+void Board::generate_captures(int side, FULL_MOVE *moves, int *moves_count)
 {
-    if (!(i >= 0 && i < H && j >= 0 && j < W))
-        return false;
-    if ((side == 0 && i <= 4) || (side == 1 && j >= 5))
-        return true;
-    else
-        return false;
+    generate(side, GEN_CAPTURES, moves, moves_count);
 }
 
-bool Board::check_position(int side, int i, int j, int *target_capture_score)
+void Board::generate_quiets(int side, FULL_MOVE *moves, int *moves_count)
 {
-    if (board[i][j].piece == 0)
-    {
-        *target_capture_score = NON_CAPTURE;
-        return true;
-    }
-    else if (piece_side(board[i][j].piece) != side)
-    {
-        *target_capture_score = capture_values[piece_type(board[i][j].piece)];
-        return true;
-    }
-    else
-        return false;
+    generate(side, GEN_QUIETS, moves, moves_count);
 }
 
-int Board::c4di[4] = {0, 1, 0, -1}, Board::c4dj[4] = {1, 0, -1, 0};
-int Board::king_moves[256][4][2], Board::king_moves_count[256] = {0};
-int Board::horse_d[8][6] = {
-    {-2, 1, -1, 0, -1, 1},
-    {-1, 2, 0, 1, -1, 1},
-    {1, 2, 0, 1, 1, 1},
-    {2, 1, 1, 0, 1, 1},
-    {2, -1, 1, 0, 1, -1},
-    {1, -2, 0, -1, 1, -1},
-    {-1, -2, 0, -1, -1, -1},
-    {-2, -1, -1, 0, -1, -1}
-};
-int Board::horse_moves[256][8][6], Board::horse_moves_count[256];
-int Board::s4di[4] = {1, 1, -1, -1}, Board::s4dj[4] = {-1, 1, 1, -1};
-int Board::elephant_positions[7][2] = {{0, 2}, {0, 6}, {2, 0}, {2, 4}, {2, 8}, {4, 2}, {4, 6}};
-int Board::elephant_moves[256][4][4], Board::elephant_moves_count[256];
-int Board::advisor_moves[256][4][2], Board::advisor_moves_count[256];
-int Board::pawn_moves[2][256][3][2], Board::pawn_moves_count[2][256];
-
-Board::BoardStaticFieldsInitializer Board::board_initializer;
-
-Board::BoardStaticFieldsInitializer::BoardStaticFieldsInitializer()
-{
-    // King
-    for (int side = 0; side <= 1; ++side)
-    {
-        for (int ii = 0; ii <= 2; ++ii)
-        {
-            int i = ii;
-            if (side == 1)
-                i = H - 1 - ii;
-            for (int j = 3; j <= 5; ++j)
-            {
-                POSITION p = make_position(i, j);
-                king_moves_count[p] = 0;
-                for (int r = 0; r < 4; ++r)
-                {
-                    int oi = i + c4di[r], oj = j + c4dj[r];
-                    if (is_in_palace(side, oi, oj))
-                    {
-                        int index = king_moves_count[p];
-                        ++king_moves_count[p];
-
-                        king_moves[p][index][0] = oi;
-                        king_moves[p][index][1] = oj;
-                    }
-                }
-            }
-        }
-    }
-
-    // Advisor
-    for (int side = 0; side <= 1; ++side)
-    {
-        for (int ii = 0; ii <= 2; ++ii)
-        {
-            int i = ii;
-            if (side == 1)
-                i = H - 1 - ii;
-            for (int j = 3; j <= 5; ++j)
-            {
-                POSITION p = make_position(i, j);
-                advisor_moves_count[p] = 0;
-                for (int r = 0; r < 4; ++r)
-                {
-                    int oi = i + s4di[r], oj = j + s4dj[r];
-                    if (is_in_palace(side, oi, oj))
-                    {
-                        int index = advisor_moves_count[p];
-                        ++advisor_moves_count[p];
-
-                        advisor_moves[p][index][0] = oi;
-                        advisor_moves[p][index][1] = oj;
-                    }
-                }
-            }
-        }
-    }
-
-    // Horse
-    for (int i = 0; i < H; ++i)
-        for (int j = 0; j < W; ++j)
-        {
-            POSITION p = make_position(i, j);
-            horse_moves_count[p] = 0;
-            for (int r = 0; r < 8; ++r)
-            {
-                int oi = i + horse_d[r][0], oj = j + horse_d[r][1];
-                if (is_on_board(oi, oj))
-                {
-                    int index = horse_moves_count[p];
-                    ++horse_moves_count[p];
-
-                    horse_moves[p][index][0] = oi;
-                    horse_moves[p][index][1] = oj;
-                    horse_moves[p][index][2] = i + horse_d[r][2];
-                    horse_moves[p][index][3] = j + horse_d[r][3];
-                    horse_moves[p][index][4] = i + horse_d[r][4];
-                    horse_moves[p][index][5] = j + horse_d[r][5];
-                }
-            }
-        }
-
-    // Elephant
-    for (int k = 0; k < 7; ++k)
-    {
-        int i = elephant_positions[k][0], j = elephant_positions[k][1];
-        POSITION p = make_position(i, j);
-        elephant_moves_count[p] = 0;
-        for (int r = 0; r < 4; ++r)
-        {
-            int oi = i + s4di[r] * 2, oj = j + s4dj[r] * 2;
-            if (is_in_half(0, oi, oj))
-            {
-                int index = elephant_moves_count[p];
-                ++elephant_moves_count[p];
-
-                elephant_moves[p][index][0] = oi;
-                elephant_moves[p][index][1] = oj;
-                elephant_moves[p][index][2] = i + s4di[r];
-                elephant_moves[p][index][3] = j + s4dj[r];
-            }
-        }
-
-        int pi = H - 1 - i, pj = j;
-        POSITION pp = make_position(pi, pj);
-        elephant_moves_count[pp] = elephant_moves_count[p];
-        for (int kk = 0; kk < elephant_moves_count[p]; ++kk)
-        {
-            elephant_moves[pp][kk][0] = H - 1 - elephant_moves[p][kk][0];
-            elephant_moves[pp][kk][1] = elephant_moves[p][kk][1];
-            elephant_moves[pp][kk][2] = H - 1 - elephant_moves[p][kk][2];
-            elephant_moves[pp][kk][3] = elephant_moves[p][kk][3];
-        }
-    }
-
-    // Pawn
-    for (int i = 3; i <= 4; ++i)
-        for (int j = 0; j < W; j += 2)
-        {
-            POSITION p = make_position(i, j);
-            pawn_moves_count[0][p] = 1;
-            pawn_moves[0][p][0][0] = i + 1;
-            pawn_moves[0][p][0][1] = j;
-        }
-    for (int i = 5; i < H; ++i)
-        for (int j = 0; j < W; ++j)
-        {
-            POSITION p = make_position(i, j);
-            pawn_moves_count[0][p] = 0;
-            for (int r = 0; r < 4; ++r)
-            {
-                int oi = i + c4di[r], oj = j + c4dj[r];
-                if (c4di[r] >= 0 && is_on_board(oi, oj))
-                {
-                    int index = pawn_moves_count[0][p];
-                    ++pawn_moves_count[0][p];
-
-                    pawn_moves[0][p][index][0] = oi;
-                    pawn_moves[0][p][index][1] = oj;
-                }
-            }
-        }
-    for (int i = 0; i < H; ++i)
-        for (int j = 0; j < W; ++j)
-        {
-            int pi = H - 1 - i, pj = j;
-            if (pawn_moves_count[0][make_position(pi, pj)] > 0)
-            {
-                pawn_moves_count[1][make_position(i, j)] = pawn_moves_count[0][make_position(pi, pj)];
-                for (int r = 0; r < pawn_moves_count[1][make_position(i, j)]; ++r)
-                {
-                    pawn_moves[1][make_position(i, j)][r][0] = H - 1 - pawn_moves[0][make_position(pi, pj)][r][0];
-                    pawn_moves[1][make_position(i, j)][r][1] = pawn_moves[0][make_position(pi, pj)][r][1];
-                }
-            }
-        }
-}
-
-void Board::add_move(MOVE *moves, int *capture_scores, int *moves_count, MOVE move_to_add, int capture_score)
-{
-    moves[*moves_count] = move_to_add;
-    capture_scores[*moves_count] = capture_score;
-    ++*moves_count;
-}
-
-void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate(int side, int type, FULL_MOVE *moves, int *moves_count)
 {
     int index;
     *moves_count = 0;
@@ -783,7 +751,7 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 2; ++i)
         if (pieces[index + i].piece != 0)
-            generate_rook_moves(index + i, moves, capture_scores, moves_count);
+            generate_rook_moves(index + i, type, moves, moves_count);
 
     // Horse
     index = 5;
@@ -791,7 +759,7 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 2; ++i)
         if (pieces[index + i].piece != 0)
-            generate_horse_moves(index + i, moves, capture_scores, moves_count);
+            generate_horse_moves(index + i, type, moves, moves_count);
 
     // Cannon
     index = 9;
@@ -799,7 +767,7 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 2; ++i)
         if (pieces[index + i].piece != 0)
-            generate_cannon_moves(index + i, moves, capture_scores, moves_count);
+            generate_cannon_moves(index + i, type, moves, moves_count);
 
     // Pawn
     index = 11;
@@ -807,7 +775,7 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 5; ++i)
         if (pieces[index + i].piece != 0)
-            generate_pawn_moves(index + i, moves, capture_scores, moves_count);
+            generate_pawn_moves(index + i, type, moves, moves_count);
 
     // Advisor
     index = 1;
@@ -815,7 +783,7 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 2; ++i)
         if (pieces[index + i].piece != 0)
-            generate_advisor_moves(index + i, moves, capture_scores, moves_count);
+            generate_advisor_moves(index + i, type, moves, moves_count);
 
     // Elephant
     index = 3;
@@ -823,319 +791,661 @@ void Board::generate_moves(int side, MOVE *moves, int *capture_scores, int *move
         index += 16;
     for (int i = 0; i < 2; ++i)
         if (pieces[index + i].piece != 0)
-            generate_elephant_moves(index + i, moves, capture_scores, moves_count);
+            generate_elephant_moves(index + i, type, moves, moves_count);
 
     // King
     index = 0;
     if (side != 0)
         index += 16;
-    generate_king_moves(index, moves, capture_scores, moves_count);
+    generate_king_moves(index, type, moves, moves_count);
+
+    PinInfo info;
+    init_pin_info(side, &info);
+    remove_illegal_moves(side, in_check(side) ? NULL : &info, 0, moves, moves_count);
 }
 
-void Board::generate_king_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_piece_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
-    POSITION pos = pieces[index].position;
-    int side = piece_side(pieces[index].piece);
-    for (int i = 0; i < king_moves_count[pos]; ++i)
+    switch (piece_type(pieces[index].piece))
     {
-        int oi = king_moves[pos][i][0], oj = king_moves[pos][i][1];
-        int capture_value;
-        if (check_position(side, oi, oj, &capture_value))
-            add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                    capture_value * 8 - capture_values[PIECE_K]);
+        case PIECE_K:
+            generate_king_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_A:
+            generate_advisor_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_E:
+            generate_elephant_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_H:
+            generate_horse_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_R:
+            generate_rook_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_C:
+            generate_cannon_moves(index, type, moves, moves_count);
+            break;
+
+        case PIECE_P:
+            generate_pawn_moves(index, type, moves, moves_count);
+            break;
     }
 }
 
-void Board::generate_advisor_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+Bitboard Board::target_squares(int side, int type)
 {
-    POSITION pos = pieces[index].position;
-    int side = piece_side(pieces[index].piece);
-    for (int i = 0; i < advisor_moves_count[pos]; ++i)
+    if (type == GEN_CAPTURES)
+        return occupancy[1 - side];
+    else if (type == GEN_QUIETS)
+        return ~(occupancy[0] | occupancy[1]);
+    else
+        return ~occupancy[side];
+}
+
+void Board::add_moves(POSITION pos, Bitboard targets, PIECE piece, FULL_MOVE *moves, int *moves_count)
+{
+    while (!targets.empty())
     {
-        int oi = advisor_moves[pos][i][0], oj = advisor_moves[pos][i][1];
-        int capture_value;
-        if (check_position(side, oi, oj, &capture_value))
-            add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                    capture_value * 8 - capture_values[PIECE_A]);
+        POSITION dst = square_position(targets.pop());
+        add_move(moves, moves_count, pos, dst, piece, board[dst].piece);
     }
 }
 
-void Board::generate_rook_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_king_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
     POSITION pos = pieces[index].position;
     int side = piece_side(pieces[index].piece);
-
-    int i = position_rank(pos), j = position_file(pos);
-    for (int r = 0; r < 4; ++r)
-    {
-        int oi = i, oj = j;
-        while (true)
-        {
-            oi += c4di[r];
-            oj += c4dj[r];
-
-            if (!is_on_board(oi, oj))
-                break;
-
-            if (board[oi][oj].piece == 0)
-                add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                        NON_CAPTURE);
-            else
-            {
-                int capture_value;
-                if (check_position(side, oi, oj, &capture_value))
-                    add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                            capture_value * 8 - capture_values[PIECE_R]);
-                break;
-            }
-        }
-    }
+    add_moves(pos, tables.king_masks[position_square(pos)] & target_squares(side, type), pieces[index].piece,
+            moves, moves_count);
 }
 
-void Board::generate_horse_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_advisor_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
     POSITION pos = pieces[index].position;
     int side = piece_side(pieces[index].piece);
+    add_moves(pos, tables.advisor_masks[position_square(pos)] & target_squares(side, type), pieces[index].piece,
+            moves, moves_count);
+}
 
-    for (int i = 0; i < horse_moves_count[pos]; ++i)
+// Adds the moves of a slider at pos: rank masks are passed in the low 16 bits of empty and
+// targets and file masks in the high 16 bits. Targets holding own pieces are skipped.
+void Board::add_slide_moves(POSITION pos, int empty, int targets, PIECE piece,
+        FULL_MOVE *moves, int *moves_count)
+{
+    int i = position_rank(pos), j = position_file(pos);
+    int side = piece_side(piece);
+    for (; empty; empty &= empty - 1)
     {
-        int oi = horse_moves[pos][i][0], oj = horse_moves[pos][i][1];
-        int capture_value;
-        if (check_position(side, oi, oj, &capture_value) &&
-                board[horse_moves[pos][i][2]][horse_moves[pos][i][3]].piece == 0)
-            add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                    capture_value * 8 - capture_values[PIECE_H]);
+        int k = __builtin_ctz(empty);
+        POSITION dst = k < 16 ? make_position(i, k) : make_position(k - 16, j);
+        add_move(moves, moves_count, pos, dst, piece, 0);
     }
+    for (; targets; targets &= targets - 1)
+    {
+        POSITION dst = line_position(i, j, __builtin_ctz(targets));
+        PIECE target = board[dst].piece;
+        if (piece_side(target) != side)
+            add_move(moves, moves_count, pos, dst, piece, target);
+    }
+}
+
+void Board::generate_rook_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
+{
+    POSITION pos = pieces[index].position;
+    int i = position_rank(pos), j = position_file(pos);
+    const SlideEntry &rank = tables.rank_slides[j][rank_occupancy[i]], &file = tables.file_slides[i][file_occupancy[j]];
+    add_slide_moves(pos,
+            type != GEN_CAPTURES ? rank.empty | (file.empty << 16) : 0,
+            type != GEN_QUIETS ? rank.first | (file.first << 16) : 0,
+            pieces[index].piece, moves, moves_count);
 }
 
-void Board::generate_cannon_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_horse_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
     POSITION pos = pieces[index].position;
     int side = piece_side(pieces[index].piece);
+    Bitboard targets = target_squares(side, type);
 
-    int i = position_rank(pos), j = position_file(pos);
-    for (int r = 0; r < 4; ++r)
+    for (const POSITION *step = tables.horse_steps[position_square(pos)][0]; *step != INVALID_POSITION; step += 2)
     {
-        int oi = i, oj = j;
-        int state = 0;
-        while (true)
-        {
-            oi += c4di[r];
-            oj += c4dj[r];
+        POSITION dst = step[0];
+        if (board[step[1]].piece != 0 || !targets.test(position_square(dst)))
+            continue;
 
-            if (!is_on_board(oi, oj))
-                break;
-
-            if (state == 0)
-            {
-                if (board[oi][oj].piece == 0)
-                    add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)), NON_CAPTURE);
-                else
-                    state = 1;
-            }
-            else if (state == 1)
-            {
-                if (board[oi][oj].piece != 0)
-                {
-                    int capture_value;
-                    if (check_position(side, oi, oj, &capture_value))
-                        add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                                capture_value * 8 - capture_values[PIECE_C]);
-                    break;
-                }
-            }
-        }
+        add_move(moves, moves_count, pos, dst, pieces[index].piece, board[dst].piece);
     }
 }
 
-void Board::generate_elephant_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_cannon_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
+{
+    POSITION pos = pieces[index].position;
+    int i = position_rank(pos), j = position_file(pos);
+    const SlideEntry &rank = tables.rank_slides[j][rank_occupancy[i]], &file = tables.file_slides[i][file_occupancy[j]];
+    add_slide_moves(pos,
+            type != GEN_CAPTURES ? rank.empty | (file.empty << 16) : 0,
+            type != GEN_QUIETS ? rank.second | (file.second << 16) : 0,
+            pieces[index].piece, moves, moves_count);
+}
+
+void Board::generate_elephant_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
     POSITION pos = pieces[index].position;
     int side = piece_side(pieces[index].piece);
+    Bitboard targets = target_squares(side, type);
 
-    for (int i = 0; i < elephant_moves_count[pos]; ++i)
+    for (const POSITION *step = tables.elephant_steps[position_square(pos)][0]; *step != INVALID_POSITION; step += 2)
     {
-        int oi = elephant_moves[pos][i][0], oj = elephant_moves[pos][i][1];
-        int capture_value;
-        if (check_position(side, oi, oj, &capture_value) &&
-                board[elephant_moves[pos][i][2]][elephant_moves[pos][i][3]].piece == 0)
-            add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                    capture_value * 8 - capture_values[PIECE_E]);
+        POSITION dst = step[0];
+        if (board[step[1]].piece != 0 || !targets.test(position_square(dst)))
+            continue;
+
+        add_move(moves, moves_count, pos, dst, pieces[index].piece, board[dst].piece);
     }
 }
 
-void Board::generate_pawn_moves(int index, MOVE *moves, int *capture_scores, int *moves_count)
+void Board::generate_pawn_moves(int index, int type, FULL_MOVE *moves, int *moves_count)
 {
     POSITION pos = pieces[index].position;
     int side = piece_side(pieces[index].piece);
+    add_moves(pos, tables.pawn_masks[side][position_square(pos)] & target_squares(side, type), pieces[index].piece,
+            moves, moves_count);
+}
 
-    for (int i = 0; i < pawn_moves_count[side][pos]; ++i)
+void Board::generate_quiet_checks(int side, FULL_MOVE *moves, int *moves_count)
+{
+    CheckInfo info;
+    init_check_info(side, &info);
+
+    *moves_count = 0;
+    Bitboard discoverers = info.line_discoverers | info.leg_discoverers;
+    for (int index = side * 16; index < side * 16 + 16; ++index)
     {
-        int oi = pawn_moves[side][pos][i][0], oj = pawn_moves[side][pos][i][1];
-        int capture_value;
-        if (check_position(side, oi, oj, &capture_value))
-            add_move(moves, capture_scores, moves_count, make_move(pos, make_position(oi, oj)),
-                    capture_value * 8 - capture_values[PIECE_P]);
+        PIECE piece = pieces[index].piece;
+        if (piece == 0)
+            continue;
+
+        // Skip pieces that can neither discover a check nor reach a checking square
+        int sq = position_square(pieces[index].position), type = piece_type(piece);
+        if (!discoverers.test(sq) && (tables.reach_masks[type][sq] & (info.direct[type] | info.screens)).empty())
+            continue;
+
+        int start = *moves_count;
+        generate_piece_moves(index, GEN_QUIETS, moves, moves_count);
+        int c = start;
+        for (int i = start; i < *moves_count; ++i)
+            if (is_checking_move(info, moves[i]))
+            {
+                moves[c] = moves[i];
+                ++c;
+            }
+        *moves_count = c;
     }
+
+    PinInfo pin_info;
+    init_pin_info(side, &pin_info);
+    remove_illegal_moves(side, in_check(side) ? NULL : &pin_info, 0, moves, moves_count);
 }
 
-bool Board::is_attacked(POSITION pos, bool test_all_attacks, MOVE *best_attack)
+void Board::generate_evasions(int side, FULL_MOVE *moves, int *moves_count)
 {
-    int src_i = position_rank(pos), src_j = position_file(pos);
-    int side_to_attack = 1 - piece_side(board[src_i][src_j].piece);
+    assert(in_check(side));
+    Checker checkers[16];
+    int checkers_count = find_checkers(side, checkers);
+
+    *moves_count = 0;
+    int king_index = side * 16;
+    POSITION king = pieces[king_index].position;
+    int king_sq = position_square(king);
+
+    // King moves, to squares that are not attacked once the king has left its own
+    generate_king_moves(king_index, GEN_ALL, moves, moves_count);
+    toggle_piece(pieces[king_index].piece, king_sq);
+    int c = 0;
+    for (int i = 0; i < *moves_count; ++i)
+        if (!is_square_attacked(position_square(move_dst(moves[i])), 1 - side))
+        {
+            moves[c] = moves[i];
+            ++c;
+        }
+    toggle_piece(pieces[king_index].piece, king_sq);
+    *moves_count = c;
+
+    if (checkers_count == 0)
+        return;
 
-    MOVE best_response = 0;
-    int least_response_value = -1;
+    Bitboard answers = checkers[0].answers;
+    Bitboard screens;
+    for (int k = 0; k < checkers_count; ++k)
+        if (checkers[k].screen >= 0)
+            screens.set(checkers[k].screen);
 
-    // Detect attackings by rook, cannon, pawn, king
-    for (int r = 0; r < 4; ++r)
+    // Other pieces, only with moves answering every checker
+    int start = *moves_count;
+    for (int index = king_index + 1; index < king_index + 16; ++index)
     {
-        int oi = src_i, oj = src_j;
-        int len = 0;
-        bool ob = false;
-        while (true)
+        PIECE piece = pieces[index].piece;
+        if (piece == 0)
+            continue;
+
+        int sq = position_square(pieces[index].position);
+        if (!screens.test(sq) && (tables.reach_masks[piece_type(piece)][sq] & answers).empty())
+            continue;
+
+        int start = *moves_count;
+        generate_piece_moves(index, GEN_ALL, moves, moves_count);
+        int c = start;
+        for (int i = start; i < *moves_count; ++i)
         {
-            oi += c4di[r], oj += c4dj[r];
-            if (!is_on_board(oi, oj))
-                break;
+            int dst = position_square(move_dst(moves[i]));
+            bool answered = true;
+            for (int k = 0; answered && k < checkers_count; ++k)
+                answered = checkers[k].answers.test(dst)
+                    || (checkers[k].screen == sq && !checkers[k].between.test(dst));
+            if (answered)
+            {
+                moves[c] = moves[i];
+                ++c;
+            }
+        }
+        *moves_count = c;
+    }
 
-            ++len;
+    // A piece answering the check may still be pinned
+    remove_illegal_moves(side, NULL, start, moves, moves_count);
+}
+
+int Board::find_checkers(int side, Checker *checkers)
+{
+    int count = 0, enemy = 1 - side;
+    POSITION king = king_position(side);
+    int ki = position_rank(king), kj = position_file(king), ksq = ki * W + kj;
+
+    Bitboard pawns = tables.pawn_attacker_masks[enemy][ksq] & piece_boards[make_piece(enemy, PIECE_P)];
+    while (!pawns.empty())
+    {
+        Checker &checker = checkers[count++];
+        checker.answers = Bitboard::square(pawns.pop());
+        checker.between = Bitboard();
+        checker.screen = -1;
+    }
+
+    PIECE horse = make_piece(enemy, PIECE_H);
+    for (const POSITION *step = tables.horse_attacker_steps[ksq][0]; *step != INVALID_POSITION; step += 2)
+        if (board[step[0]].piece == horse && board[step[1]].piece == 0)
+        {
+            Checker &checker = checkers[count++];
+            checker.answers = Bitboard::square(position_square(step[0]));
+            checker.answers.set(position_square(step[1]));
+            checker.between = Bitboard();
+            checker.screen = -1;
+        }
 
-            PIECE p = board[oi][oj].piece;
-            if (p == 0)
+    PIECE rook = make_piece(enemy, PIECE_R), cannon = make_piece(enemy, PIECE_C);
+    for (int line = 0; line < 2; ++line)
+    {
+        int index = line == 0 ? kj : ki;
+        const SlideEntry &entry = line == 0 ? tables.rank_slides[kj][rank_occupancy[ki]] : tables.file_slides[ki][file_occupancy[kj]];
+        for (int d = 0; d < 2; ++d)
+        {
+            int direction = d == 0 ? (1 << index) - 1 : 0xffff & ~((2 << index) - 1);
+            int first = entry.first & direction, second = entry.second & direction;
+            if (!first)
                 continue;
 
-            if (len == 1)
+            POSITION fp = line_position(ki, kj, __builtin_ctz(first) + line * 16),
+                     sp = second ? line_position(ki, kj, __builtin_ctz(second) + line * 16) : INVALID_POSITION;
+            if (board[fp].piece == rook)
             {
-                if (p == make_piece(side_to_attack, PIECE_P))
-                {
-                    POSITION dst = make_position(oi, oj);
-                    for (int j = 0; j < pawn_moves_count[side_to_attack][dst]; ++j)
-                        if (pawn_moves[side_to_attack][dst][j][0] == src_i
-                                && pawn_moves[side_to_attack][dst][j][1] == src_j)
-                        {
-                            if (best_attack)
-                                *best_attack = make_move(dst, pos);
-                            return true;
-                        }
-                }
-                else if (test_all_attacks && p == make_piece(side_to_attack, PIECE_K))
-                {
-                    POSITION dst = make_position(oi, oj);
-                    for (int j = 0; j < king_moves_count[dst]; ++j)
-                        if (king_moves[dst][j][0] == src_i
-                                && king_moves[dst][j][1] == src_j)
-                        {
-                            if (best_attack)
-                            {
-                                if (least_response_value == -1
-                                        || capture_values[PIECE_K] < least_response_value)
-                                {
-                                    least_response_value = capture_values[PIECE_K];
-                                    best_response = make_move(dst, pos);
-                                }
-                            }
-                            else
-                                return true;
-                        }
-                }
+                Checker &checker = checkers[count++];
+                checker.answers = (line == 0 ? rank_squares(ki, entry.empty & direction)
+                        : file_squares(kj, entry.empty & direction)) | Bitboard::square(position_square(fp));
+                checker.between = Bitboard();
+                checker.screen = -1;
             }
-
-            if (!ob)
+            else if (second && board[sp].piece == cannon)
             {
-                if (p == make_piece(side_to_attack, PIECE_R))
-                {
-                    if (best_attack)
-                    {
-                        if (least_response_value == -1 ||
-                                capture_values[PIECE_R] < least_response_value)
-                        {
-                            least_response_value = capture_values[PIECE_R];
-                            best_response = make_move(make_position(oi, oj), pos);
-                        }
-                    }
-                    else
-                        return true;
-                }
-                ob = true;
+                Checker &checker = checkers[count++];
+                int between = (entry.empty | entry.beyond) & direction;
+                checker.between = (line == 0 ? rank_squares(ki, between) : file_squares(kj, between));
+                checker.answers = checker.between | Bitboard::square(position_square(sp));
+                checker.between.set(position_square(fp));
+                checker.screen = position_square(fp);
             }
-            else
+        }
+    }
+
+    return count;
+}
+
+// Whether side attacks square sq, judged from the occupancy bitboards so that a piece can be
+// lifted with toggle_piece first. Facing kings count as an attack.
+bool Board::is_square_attacked(int sq, int side)
+{
+    int i = sq / W, j = sq % W;
+    Bitboard occupied = occupancy[0] | occupancy[1];
+
+    if (!(tables.pawn_attacker_masks[side][sq] & piece_boards[make_piece(side, PIECE_P)]).empty())
+        return true;
+
+    Bitboard horses = tables.horse_masks[sq] & piece_boards[make_piece(side, PIECE_H)];
+    if (!horses.empty())
+        for (const POSITION *step = tables.horse_attacker_steps[sq][0]; *step != INVALID_POSITION; step += 2)
+            if (horses.test(position_square(step[0])) && !occupied.test(position_square(step[1])))
+                return true;
+
+    const SlideEntry &rank = tables.rank_slides[j][rank_occupancy[i]], &file = tables.file_slides[i][file_occupancy[j]];
+    Bitboard firsts = rank_squares(i, rank.first) | file_squares(j, file.first);
+    Bitboard seconds = rank_squares(i, rank.second) | file_squares(j, file.second);
+    if (!(firsts & (piece_boards[make_piece(side, PIECE_R)] | piece_boards[make_piece(side, PIECE_K)])).empty())
+        return true;
+    if (!(seconds & piece_boards[make_piece(side, PIECE_C)]).empty())
+        return true;
+
+    return false;
+}
+
+void Board::init_pin_info(int side, PinInfo *info)
+{
+    int enemy = 1 - side;
+    POSITION king = king_position(side);
+    int ki = position_rank(king), kj = position_file(king), ksq = ki * W + kj;
+    info->pinned = info->screens = Bitboard();
+
+    PIECE rook = make_piece(enemy, PIECE_R), cannon = make_piece(enemy, PIECE_C), other_king = make_piece(enemy, PIECE_K);
+    for (int line = 0; line < 2; ++line)
+    {
+        int index = line == 0 ? kj : ki;
+        int occ = line == 0 ? rank_occupancy[ki] : file_occupancy[kj];
+        const SlideEntry *slides = line == 0 ? tables.rank_slides[kj] : tables.file_slides[ki];
+        const SlideEntry &entry = slides[occ];
+
+        for (int d = 0; d < 2; ++d)
+        {
+            int direction = d == 0 ? (1 << index) - 1 : 0xffff & ~((2 << index) - 1);
+            int blockers = (entry.first | entry.second) & direction;
+            for (; blockers; blockers &= blockers - 1)
             {
-                if (p == make_piece(side_to_attack, PIECE_C))
-                {
-                    if (best_attack)
-                    {
-                        if (least_response_value == -1 ||
-                                capture_values[PIECE_C] < least_response_value)
-                        {
-                            least_response_value = capture_values[PIECE_C];
-                            best_response = make_move(make_position(oi, oj), pos);
-                        }
-                    }
-                    else
-                        return true;
-                }
-                break;
+                int k = __builtin_ctz(blockers);
+                POSITION p = line_position(ki, kj, k + line * 16);
+                PIECE piece = board[p].piece;
+
+                if (piece == cannon && (entry.first & (1 << k)))
+                    info->screens |= line == 0 ? rank_squares(ki, entry.empty & direction)
+                        : file_squares(kj, entry.empty & direction);
+
+                if (piece_side(piece) != side)
+                    continue;
+
+                // Would taking this piece off the line uncover a rook, a cannon or the other king?
+                const SlideEntry &uncovered = slides[occ ^ (1 << k)];
+                int r = uncovered.first & direction, c = uncovered.second & direction;
+                PIECE rpiece = r ? board[line_position(ki, kj, __builtin_ctz(r) + line * 16)].piece : 0,
+                      cpiece = c ? board[line_position(ki, kj, __builtin_ctz(c) + line * 16)].piece : 0;
+                if (rpiece == rook || (line == 1 && rpiece == other_king) || cpiece == cannon)
+                    info->pinned.set(position_square(p));
             }
         }
     }
 
-    // Detect attackings by horse
-    for (int i = 0; i < horse_moves_count[pos]; ++i)
+    PIECE horse = make_piece(enemy, PIECE_H);
+    for (const POSITION *step = tables.horse_attacker_steps[ksq][0]; *step != INVALID_POSITION; step += 2)
+        if (board[step[0]].piece == horse && board[step[1]].piece != 0 && piece_side(board[step[1]].piece) == side)
+            info->pinned.set(position_square(step[1]));
+}
+
+// Whether side's king is safe after move, judged by toggling the occupancy bitboards rather
+// than making the move.
+bool Board::is_legal_move(int side, MOVE move)
+{
+    POSITION src = move_src(move), dst = move_dst(move);
+    int src_sq = position_square(src), dst_sq = position_square(dst);
+    PIECE piece = board[src].piece,
+          captured = board[dst].piece;
+
+    if (captured != 0)
+        toggle_piece(captured, dst_sq);
+    toggle_piece(piece, src_sq);
+    toggle_piece(piece, dst_sq);
+
+    int king_sq = piece_type(piece) == PIECE_K ? dst_sq : position_square(king_position(side));
+    bool legal = !is_square_attacked(king_sq, 1 - side);
+
+    toggle_piece(piece, dst_sq);
+    toggle_piece(piece, src_sq);
+    if (captured != 0)
+        toggle_piece(captured, dst_sq);
+
+    return legal;
+}
+
+// Drops the moves from start on that leave side's king attacked. Only king moves, moves of
+// pinned pieces and moves onto a cannon's screen squares are tested; with no info every move is.
+void Board::remove_illegal_moves(int side, const PinInfo *info, int start, FULL_MOVE *moves, int *moves_count)
+{
+    POSITION king = king_position(side);
+    int c = start;
+    for (int i = start; i < *moves_count; ++i)
+    {
+        POSITION src = move_src(moves[i]);
+        bool suspect = !info || src == king || info->pinned.test(position_square(src))
+            || info->screens.test(position_square(move_dst(moves[i])));
+        if (suspect && !is_legal_move(side, moves[i]))
+            continue;
+
+        moves[c] = moves[i];
+        ++c;
+    }
+    *moves_count = c;
+}
+
+void Board::init_check_info(int side, CheckInfo *info)
+{
+    POSITION king = king_position(1 - side);
+    int ki = position_rank(king), kj = position_file(king), ksq = ki * W + kj;
+    const SlideEntry &rank = tables.rank_slides[kj][rank_occupancy[ki]], &file = tables.file_slides[ki][file_occupancy[kj]];
+
+    info->king = king;
+    for (int i = 0; i < 8; ++i)
+        info->direct[i] = Bitboard();
+    info->direct[PIECE_R] = rank_squares(ki, rank.empty | rank.first) | file_squares(kj, file.empty | file.first);
+    info->direct[PIECE_C] = rank_squares(ki, rank.beyond | rank.second) | file_squares(kj, file.beyond | file.second);
+    info->direct[PIECE_P] = tables.pawn_attacker_masks[side][ksq];
+    info->line_discoverers = info->leg_discoverers = info->screens = info->screen_cannons = Bitboard();
+
+    PIECE rook = make_piece(side, PIECE_R), cannon = make_piece(side, PIECE_C);
+    for (int line = 0; line < 2; ++line)
     {
-        int oi = horse_moves[pos][i][0], oj = horse_moves[pos][i][1];
-        if (board[oi][oj].piece == make_piece(side_to_attack, PIECE_H)
-                && board[horse_moves[pos][i][4]][horse_moves[pos][i][5]].piece == 0)
+        // Index of the king on the line and the line's occupancy
+        int index = line == 0 ? kj : ki;
+        int occ = line == 0 ? rank_occupancy[ki] : file_occupancy[kj];
+        const SlideEntry *slides = line == 0 ? tables.rank_slides[kj] : tables.file_slides[ki];
+        const SlideEntry &entry = slides[occ];
+
+        for (int d = 0; d < 2; ++d)
         {
-            if (best_attack)
+            int direction = d == 0 ? (1 << index) - 1 : 0xffff & ~((2 << index) - 1);
+            int blockers = (entry.first | entry.second) & direction;
+            for (; blockers; blockers &= blockers - 1)
             {
-                if (least_response_value == -1 ||
-                        capture_values[PIECE_H] < least_response_value)
+                int k = __builtin_ctz(blockers);
+                POSITION p = line_position(ki, kj, k + line * 16);
+                PIECE piece = board[p].piece;
+
+                if (piece == cannon && (entry.first & (1 << k)))
                 {
-                    least_response_value = capture_values[PIECE_H];
-                    best_response = make_move(make_position(oi, oj), pos);
+                    info->screen_cannons.set(position_square(p));
+                    info->screens |= line == 0 ? rank_squares(ki, entry.empty & direction)
+                        : file_squares(kj, entry.empty & direction);
                 }
+
+                if (piece_side(piece) != side)
+                    continue;
+
+                // Would taking this piece off the line uncover a rook or cannon?
+                const SlideEntry &uncovered = slides[occ ^ (1 << k)];
+                int r = uncovered.first & direction, c = uncovered.second & direction;
+                if ((r && board[line_position(ki, kj, __builtin_ctz(r) + line * 16)].piece == rook)
+                        || (c && board[line_position(ki, kj, __builtin_ctz(c) + line * 16)].piece == cannon))
+                    info->line_discoverers.set(position_square(p));
             }
-            else
-                return true;
         }
     }
 
-    if (test_all_attacks)
+    PIECE horse = make_piece(side, PIECE_H);
+    for (const POSITION *step = tables.horse_attacker_steps[ksq][0]; *step != INVALID_POSITION; step += 2)
     {
-        // Detect attackings by elephant
-        for (int i = 0; i < elephant_moves_count[pos]; ++i)
-        {
-            int oi = elephant_moves[pos][i][0], oj = elephant_moves[pos][i][1];
-            if (board[oi][oj].piece == make_piece(side_to_attack, PIECE_E)
-                    && board[elephant_moves[pos][i][2]][elephant_moves[pos][i][3]].piece == 0)
+        PIECE leg = board[step[1]].piece;
+        if (leg == 0)
+            info->direct[PIECE_H].set(position_square(step[0]));
+        else if (board[step[0]].piece == horse && piece_side(leg) == side)
+            info->leg_discoverers.set(position_square(step[1]));
+    }
+}
+
+bool Board::is_checking_move(const CheckInfo &info, MOVE move)
+{
+    POSITION src = move_src(move), dst = move_dst(move), king = info.king;
+    int src_sq = position_square(src), dst_sq = position_square(dst);
+    int type = piece_type(board[src].piece);
+
+    // Whether the piece moves along the king's rank or file
+    bool along_line = (position_rank(src) == position_rank(king) && position_rank(dst) == position_rank(king))
+        || (position_file(src) == position_file(king) && position_file(dst) == position_file(king));
+
+    if (along_line && (type == PIECE_R || type == PIECE_C))
+    {
+        // The line's occupancy changes under the slider itself, so look along it again
+        bool on_rank = position_rank(src) == position_rank(king);
+        int ki = position_rank(king), kj = position_file(king);
+        int occ = on_rank ? rank_occupancy[ki] : file_occupancy[kj];
+        int src_bit = 1 << (on_rank ? position_file(src) : position_rank(src)),
+            dst_bit = 1 << (on_rank ? position_file(dst) : position_rank(dst));
+        const SlideEntry &entry = on_rank ? tables.rank_slides[kj][(occ & ~src_bit) | dst_bit]
+            : tables.file_slides[ki][(occ & ~src_bit) | dst_bit];
+        if ((type == PIECE_R ? entry.first : entry.second) & dst_bit)
+            return true;
+    }
+    else if (info.direct[type].test(dst_sq))
+        return true;
+    if (info.leg_discoverers.test(src_sq))
+        return true;
+    // Along the line the piece still blocks it, unless it captures: then only its old square empties
+    if (info.line_discoverers.test(src_sq) && (!along_line || board[dst].piece != 0))
+        return true;
+    if (info.screens.test(dst_sq) && !(along_line && info.screen_cannons.test(src_sq)))
+        return true;
+    return false;
+}
+
+bool Board::gives_check(MOVE move)
+{
+    int side = piece_side(board[move_src(move)].piece);
+    uint64_t key = hash_code(side);
+    if (!check_info_valid || check_info_key != key)
+    {
+        init_check_info(side, &check_info);
+        check_info_key = key;
+        check_info_valid = true;
+    }
+    return is_checking_move(check_info, move);
+}
+
+Bitboard BoardState::piece_attacks(int index) const
+{
+    PIECE piece = pieces[index].piece;
+    POSITION pos = pieces[index].position;
+    int i = position_rank(pos), j = position_file(pos), sq = i * Board::W + j;
+    Bitboard ret;
+
+    switch (piece_type(piece))
+    {
+        case PIECE_K:
             {
-                if (best_attack)
-                    *best_attack = make_move(make_position(oi, oj), pos);
-                return true;
+                // The first piece along the file is attacked too when it is the other king
+                const SlideEntry &file = tables.file_slides[i][file_occupancy[j]];
+                return tables.king_masks[sq] | (file_squares(j, file.first) & piece_boards[make_piece(1 - (index >> 4), PIECE_K)]);
             }
-        }
 
-        // Detect attackings by advisor
-        for (int i = 0; i < advisor_moves_count[pos]; ++i)
-        {
-            int oi = advisor_moves[pos][i][0], oj = advisor_moves[pos][i][1];
-            if (board[oi][oj].piece == make_piece(side_to_attack, PIECE_A))
+        case PIECE_A:
+            return tables.advisor_masks[sq];
+
+        case PIECE_P:
+            return tables.pawn_masks[piece_side(piece)][sq];
+
+        case PIECE_E:
+            for (const POSITION *step = tables.elephant_steps[sq][0]; *step != INVALID_POSITION; step += 2)
+                if (board[step[1]].piece == 0)
+                    ret.set(position_square(step[0]));
+            return ret;
+
+        case PIECE_H:
+            for (const POSITION *step = tables.horse_steps[sq][0]; *step != INVALID_POSITION; step += 2)
+                if (board[step[1]].piece == 0)
+                    ret.set(position_square(step[0]));
+            return ret;
+
+        case PIECE_R:
             {
-                if (best_attack)
-                    *best_attack = make_move(make_position(oi, oj), pos);
-                return true;
+                const SlideEntry &rank = tables.rank_slides[j][rank_occupancy[i]], &file = tables.file_slides[i][file_occupancy[j]];
+                return rank_squares(i, rank.empty | rank.first) | file_squares(j, file.empty | file.first);
+            }
+
+        case PIECE_C:
+            {
+                const SlideEntry &rank = tables.rank_slides[j][rank_occupancy[i]], &file = tables.file_slides[i][file_occupancy[j]];
+                return rank_squares(i, rank.beyond | rank.second) | file_squares(j, file.beyond | file.second);
             }
-        }
     }
+    return ret;
+}
 
-    if (least_response_value == -1)
-        return false;
+// Attacker types from the least valuable up, the order least_valuable_attacker picks in
+static const int attacker_order[7] = {PIECE_P, PIECE_E, PIECE_A, PIECE_C, PIECE_H, PIECE_R, PIECE_K};
 
-    if (best_attack)
-        *best_attack = best_response;
-    return true;
-    return false;
+Bitboard BoardState::attackers_to(POSITION pos, int side, const Bitboard &occupied) const
+{
+    int i = position_rank(pos), j = position_file(pos), sq = i * Board::W + j;
+    Bitboard ret = tables.pawn_attacker_masks[side][sq] & piece_boards[make_piece(side, PIECE_P)];
+    ret |= tables.advisor_masks[sq] & piece_boards[make_piece(side, PIECE_A)];
+    ret |= tables.king_masks[sq] & piece_boards[make_piece(side, PIECE_K)];
+
+    Bitboard elephants = tables.elephant_masks[sq] & piece_boards[make_piece(side, PIECE_E)];
+    if (!elephants.empty())
+        for (const POSITION *step = tables.elephant_steps[sq][0]; *step != INVALID_POSITION; step += 2)
+            if (elephants.test(position_square(step[0])) && !occupied.test(position_square(step[1])))
+                ret.set(position_square(step[0]));
+
+    Bitboard horses = tables.horse_masks[sq] & piece_boards[make_piece(side, PIECE_H)];
+    if (!horses.empty())
+        for (const POSITION *step = tables.horse_attacker_steps[sq][0]; *step != INVALID_POSITION; step += 2)
+            if (horses.test(position_square(step[0])) && !occupied.test(position_square(step[1])))
+                ret.set(position_square(step[0]));
+
+    const SlideEntry &rank = tables.rank_slides[j][rank_mask(occupied, i)],
+          &file = tables.file_slides[i][file_mask(occupied, j)];
+    ret |= (rank_squares(i, rank.first) | file_squares(j, file.first)) & piece_boards[make_piece(side, PIECE_R)];
+    ret |= (rank_squares(i, rank.second) | file_squares(j, file.second)) & piece_boards[make_piece(side, PIECE_C)];
+
+    return ret & occupied;
+}
+
+POSITION Board::least_valuable_attacker(POSITION pos, int side, const Bitboard &occupied)
+{
+    Bitboard found = attackers_to(pos, side, occupied);
+    if (found.empty())
+        return INVALID_POSITION;
+    for (int k = 0; ; ++k)
+    {
+        Bitboard typed = found & piece_boards[make_piece(side, attacker_order[k])];
+        if (!typed.empty())
+            return square_position(typed.pop());
+    }
 }
 
 bool Board::in_check(int side)
@@ -1143,21 +1453,7 @@ bool Board::in_check(int side)
     int index = 0;
     if (side != 0)
         index += 16;
-    POSITION pos = pieces[index].position;
-    return is_attacked(pos, false);
-}
-
-bool Board::king_face_to_face()
-{
-    if (pieces[0].piece == 0 || pieces[16].piece == 0)
-        return false;
-    POSITION pos1 = pieces[0].position, pos2 = pieces[16].position;
-    if (position_file(pos1) != position_file(pos2))
-        return false;
-    for (int i = position_rank(pos1) + 1; i <= position_rank(pos2) - 1; ++i)
-        if (board[i][position_file(pos1)].piece != 0)
-            return false;
-    return true;
+    return is_square_attacked(position_square(pieces[index].position), 1 - side);
 }
 
 string Board::fen_string(int side)
@@ -1168,13 +1464,14 @@ string Board::fen_string(int side)
         int c = 0;
         for (int j = 0; j < W; ++j)
         {
-            if (board[i][j].piece == 0)
+            PIECE piece = board[make_position(i, j)].piece;
+            if (piece == 0)
                 ++c;
             else
             {
                 if (c != 0)
                     s += ('0' + c);
-                s += piece_letter(board[i][j].piece);
+                s += piece_letter(piece);
                 c = 0;
             }
         }
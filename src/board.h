@@ -6,7 +6,14 @@
 
 #include "piece.h"
 #include "move.h"
-#include "hash.h"
+#include "bitboard.h"
+
+enum GenerationType
+{
+    GEN_ALL,
+    GEN_CAPTURES,
+    GEN_QUIETS
+};
 
 enum MoveType
 {
@@ -17,27 +24,126 @@ enum MoveType
     REGULAR
 };
 
-class Board
+// Build with -DCOPY_MAKE to have move save the whole BoardState and unmove copy it back,
+// instead of undoing the move field by field.
+#ifdef COPY_MAKE
+const bool USE_COPY_MAKE = true;
+#else
+const bool USE_COPY_MAKE = false;
+#endif
+
+// Everything about the position that a move changes, kept in one trivially copyable block
+struct BoardState
+{
+    typedef struct sBoardEntry
+    {
+        uint8_t index;
+        PIECE piece;
+    } BoardEntry;
+
+    typedef struct sPieceEntry
+    {
+        POSITION position;
+        PIECE piece;
+    } PieceEntry;
+
+    // Indexed by POSITION. Cells with a file of 9 or more or a rank of 10 or more hold
+    // OFF_BOARD, so a move read from outside, such as a hash or killer move, can be
+    // rejected by looking at its squares.
+    static const int BOARD_SIZE = 256;
+    static const PIECE OFF_BOARD = 0xff;
+    BoardEntry board[BOARD_SIZE];
+    PieceEntry pieces[32];
+
+    // Occupied squares by side and by piece, kept in step with board and pieces.
+    Bitboard occupancy[2];
+    Bitboard piece_boards[16];
+    // Bit j of rank_occupancy[i] and bit i of file_occupancy[j] are set when square (i, j) is occupied.
+    uint16_t rank_occupancy[10], file_occupancy[9];
+
+    uint64_t hash;
+    int current_static_value;
+
+    // Queries and changes that only read or write the fields above, so that they also work on
+    // a copy of the state
+    inline void toggle_piece(PIECE piece, int sq);
+    // Moves the piece on from to the empty square to, leaving hash and static value alone
+    void shift_piece(POSITION from, POSITION to);
+    // Squares the piece at index attacks
+    Bitboard piece_attacks(int index) const;
+    // Squares of the pieces of side attacking pos, as if only the squares in occupied were
+    // occupied: pieces taken off occupied uncover the pieces behind them and can make or
+    // break cannon screens
+    Bitboard attackers_to(POSITION pos, int side, const Bitboard &occupied) const;
+};
+
+class Board : protected BoardState
 {
     public:
         Board(std::string fen = "rheakaehr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RHEAKAEHR");
 
         void set(std::string fen);
 
-        bool move(MOVE m, MoveType *move_type = NULL, bool detect_repetition = true);
+        // Without detect_repetition the move is never judged a repetition and records no check,
+        // so a repetition through it later counts it as not checking
+        void move(MOVE m, MoveType *move_type = NULL, bool detect_repetition = true);
         bool checked_move(int side, MOVE m, MoveType *move_type = NULL);
+        // Whether m moves one of side's pieces the way the piece moves, to a square not held by
+        // side, with no leg, eye or line blocked: checked against the tables without making it
+        bool is_pseudo_legal(int side, MOVE m);
+        // Whether side's king is safe after the pseudo-legal move m
+        bool is_legal_move(int side, MOVE m);
+        // Whether the legal move m checks the other king, directly, by uncovering a rook, cannon
+        // or horse, or by screening a cannon: predicted without making it
+        bool gives_check(MOVE m);
         void unmove();
         bool checked_unmove();
+        // A search marks the history where it starts and clears the mark when it is done, so
+        // that making room in a full history never drops a move the search can still unmake
+        inline void mark_history()
+        {
+            history_mark = history_count;
+        }
+        inline void clear_history_mark()
+        {
+            history_mark = MAX_HISTORY;
+        }
 
         bool in_check(int side);
-        bool is_capture(MOVE move, int *value = NULL);
+        // Fills in the moving piece, the captured piece and the capture score of a move on this board
+        FULL_MOVE full_move(MOVE move);
         POSITION king_position(int side);
-        bool is_attacked(POSITION pos, bool test_all_attacks, MOVE *best_attack = NULL);
+        using BoardState::attackers_to;
+        // The least valuable of the attackers attackers_to finds, taking pawns, elephants,
+        // advisors, cannons, horses, rooks and then the king, or INVALID_POSITION
+        POSITION least_valuable_attacker(POSITION pos, int side, const Bitboard &occupied);
+
+        inline PIECE piece_at(POSITION pos)
+        {
+            return board[pos].piece;
+        }
+        inline Bitboard occupied_squares()
+        {
+            return occupancy[0] | occupancy[1];
+        }
+        // What a piece on pos adds to the static value of its own side
+        inline int piece_value(PIECE piece, POSITION pos)
+        {
+            int value = static_values[piece][position_rank(pos)][position_file(pos)];
+            return piece_side(piece) == 0 ? value : -value;
+        }
 
         uint64_t hash_code(int side);
         int static_value(int side);
 
-        void generate_moves(int side, MOVE *moves, int *capture_scores, int *moves_count);
+        // Generated moves are legal: none leaves the mover's king attacked or facing the other king
+        void generate_moves(int side, FULL_MOVE *moves, int *moves_count);
+        void generate_captures(int side, FULL_MOVE *moves, int *moves_count);
+        void generate_quiets(int side, FULL_MOVE *moves, int *moves_count);
+        void generate_quiet_checks(int side, FULL_MOVE *moves, int *moves_count);
+        // Only for a side in check: the moves answering every checker. Out of check it would
+        // return nothing but the king's moves.
+        void generate_evasions(int side, FULL_MOVE *moves, int *moves_count);
 
         void print();
         std::string fen_string(int side);
@@ -45,73 +151,131 @@ class Board
         static const int H = 10, W = 9, NON_CAPTURE = 0, KING_CAPTURE_VALUE = 35;
 
     protected:
-        typedef struct sBoardEntry
-        {
-            uint8_t index;
-            PIECE piece;
-        } BoardEntry;
-
-        typedef struct sPieceEntry
-        {
-            POSITION position;
-            PIECE piece;
-        } PieceEntry;
-
         typedef struct sHistoryEntry
         {
             MOVE move;
             BoardEntry capture;
-            uint8_t perp_side;
+
+            // Side that moved
+            uint8_t side;
+
+            // Whether the move checked, predicted when it is made. Left clear for captures,
+            // which no repetition goes past, and for moves made without repetition detection.
+            bool gave_check;
+            // The enemy pieces it chased, by index within their side, once test_for_perpetual
+            // has needed them
+            bool chases_known;
+            uint16_t chased;
+
+            // Hash and static value before the move, restored by unmove as they are
+            uint64_t hash;
+            int static_value;
         } HistoryEntry;
-        static const int NON_PERPETUAL = 2;
 
-        BoardEntry board[H][W];
-        PieceEntry pieces[32];
+        // The pieces, other than kings and pawns, whose attacks the quiet move m, about to be
+        // made on state, may extend: the moving piece, the rooks and cannons its source square
+        // unblocks, the cannons its destination screens, and the horses and elephants whose leg
+        // or eye it frees. Fills chasers with their indices and attacks with what they attack
+        // before m, and returns how many there are.
+        int find_chasers(const BoardState &state, MOVE m, int *chasers, Bitboard *attacks);
+        // The enemy pieces, by index within their side, that side's last move on state chased:
+        // those the chasers found before it attack now and did not then
+        uint16_t chased_pieces(const BoardState &state, int side, const int *chasers, const Bitboard *attacks, int count);
 
         uint64_t get_hash(int rank, int col, PIECE piece);
         const uint64_t hash_side;
-        uint64_t hash;
 
         static const int static_values[16][H][W];
         static const int capture_values[8];
-        int current_static_value;
 
-        std::vector<HistoryEntry> history;
-        HashSet history_positions;
+        // One entry per move made, the last at history[history_count - 1]. The stack never
+        // grows: when it is full, move drops its oldest entries with compact_history first.
+        static const int MAX_HISTORY = 1024;
+        HistoryEntry history[MAX_HISTORY];
+        int history_count;
+        // Entries from history_mark up are never dropped; MAX_HISTORY when nothing is marked
+        int history_mark;
+        // Drops the entries up to the last capture, which repetitions never look past, or the
+        // older half of the stack if that frees less, but none from history_mark up. Dropped
+        // moves can no longer be unmade.
+        void compact_history();
 
-        static bool is_valid_position(PIECE piece, int i, int j);
-        static bool is_in_palace(int side, int i, int j);
-        static bool is_in_half(int side, int i, int j);
-        static bool is_on_board(int i, int j);
-        bool check_position(int side, int i, int j, int *target_capture_score);
+        // Repetitions are found by scanning history back to the last capture. The filter
+        // counts the starting position and the position after each move by the top bits of
+        // their hash, so the scan only runs when the current position shares a count with an
+        // earlier one.
+        static const bool USE_REPETITION_FILTER = true;
+        static const int REPETITION_FILTER_BITS = 10;
+        uint16_t repetition_filter[1 << REPETITION_FILTER_BITS];
+        inline uint16_t &repetition_filter_count(uint64_t position_hash)
+        {
+            return repetition_filter[position_hash >> (64 - REPETITION_FILTER_BITS)];
+        }
+        inline uint16_t &repetition_filter_count()
+        {
+            return repetition_filter_count(hash);
+        }
+        bool is_repetition();
 
-        inline bool king_face_to_face();
+        // States before each move, restored by unmove, beside the history entries of the same
+        // moves. With copy-make only. They are kept on the heap, and only as many as there are
+        // moves, so that copying a Board for another thread copies what is in use.
+        std::vector<BoardState> states;
 
+        // Whether the repetition just made is perpetual check or chase by my_side: each of its
+        // moves back to the repeated position checked or chased the same piece, and not all the
+        // other side's did. Checks are read from history; chases are worked out on a copy of the
+        // state the first time a repetition needs them, and kept there.
         bool test_for_perpetual(int my_side);
 
-        class BoardStaticFieldsInitializer
+        // Squares and pieces through which side can check the enemy king, computed once per position
+        typedef struct sCheckInfo
+        {
+            POSITION king;
+            Bitboard direct[8];             // a piece of this type checks from here
+            Bitboard line_discoverers;      // own pieces whose leaving the king's rank or file gives check
+            Bitboard leg_discoverers;       // own pieces blocking a horse leg
+            Bitboard screens;               // empty squares between the king and an unscreened own cannon
+            Bitboard screen_cannons;        // those cannons
+        } CheckInfo;
+        void init_check_info(int side, CheckInfo *info);
+        bool is_checking_move(const CheckInfo &info, MOVE move);
+
+        // Check info for gives_check, kept for the position and side last asked about
+        CheckInfo check_info;
+        uint64_t check_info_key;
+        bool check_info_valid;
+
+        // A piece giving check and the ways to answer it other than moving the king
+        typedef struct sChecker
+        {
+            Bitboard answers;   // capturing the checker or blocking its line or leg
+            Bitboard between;   // squares between a checking cannon and the king
+            int screen;         // square of a checking cannon's screen, or -1
+        } Checker;
+        int find_checkers(int side, Checker *checkers);
+        bool is_square_attacked(int sq, int side);
+
+        // Squares where a move may expose side's own king, computed once per generation
+        typedef struct sPinInfo
         {
-            public:
-                BoardStaticFieldsInitializer();
-        };
-        static BoardStaticFieldsInitializer board_initializer;
-
-        static int c4di[4], c4dj[4];
-        static int king_moves[256][4][2], king_moves_count[256];
-        static int horse_d[8][6];
-        static int horse_moves[256][8][6], horse_moves_count[256];
-        static int s4di[4], s4dj[4];
-        static int elephant_positions[7][2];
-        static int elephant_moves[256][4][4], elephant_moves_count[256];
-        static int advisor_moves[256][4][2], advisor_moves_count[256];
-        static int pawn_moves[2][256][3][2], pawn_moves_count[2][256];
-
-        void add_move(MOVE *moves, int *capture_scores, int *moves_count, MOVE move_to_add, int capture_score);
-        void generate_king_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_rook_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_horse_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_cannon_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_elephant_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_advisor_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
-        void generate_pawn_moves(int index, MOVE *moves, int *capture_scores, int *moves_count);
+            Bitboard pinned;    // own pieces whose leaving uncovers a rook, cannon, horse or the facing king
+            Bitboard screens;   // empty squares between the king and an unscreened enemy cannon
+        } PinInfo;
+        void init_pin_info(int side, PinInfo *info);
+        void remove_illegal_moves(int side, const PinInfo *info, int start, FULL_MOVE *moves, int *moves_count);
+
+        void generate(int side, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_piece_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        Bitboard target_squares(int side, int type);
+        void add_move(FULL_MOVE *moves, int *moves_count, POSITION src, POSITION dst, PIECE piece, PIECE captured);
+        void add_moves(POSITION pos, Bitboard targets, PIECE piece, FULL_MOVE *moves, int *moves_count);
+        void add_slide_moves(POSITION pos, int empty, int targets, PIECE piece, FULL_MOVE *moves, int *moves_count);
+        void generate_king_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_rook_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_horse_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_cannon_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_elephant_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_advisor_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
+        void generate_pawn_moves(int index, int type, FULL_MOVE *moves, int *moves_count);
 };
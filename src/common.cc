@@ -12,7 +12,7 @@ void catPV(PV *main, PV *cat)
     main->count += cat->count;
 }
 
-string readable_number(int x)
+string readable_number(uint64_t x)
 {
     ostringstream oss;
     if (x < 1000)
@@ -14,4 +14,4 @@ typedef struct sPV
 
 void catPV(PV *main, PV *cat);
 
-std::string readable_number(int x);
+std::string readable_number(uint64_t x);
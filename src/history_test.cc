@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+
+#include "board.h"
+#include "agent.h"
+
+using namespace std;
+
+// Plays a game long enough that a search from it fills the history stack, with captures in
+// its lines, and checks that the search leaves the board as it found it
+int main()
+{
+    Board board;
+
+    // Each side shuffles a horse out and back
+    MOVE shuffle[2][2];
+    for (int side = 0; side < 2; ++side)
+    {
+        FULL_MOVE moves[120];
+        int count;
+        board.generate_quiets(side, moves, &count);
+        for (int k = 0; k < count; ++k)
+            if (piece_type(moving_piece(moves[k])) == PIECE_H)
+            {
+                shuffle[side][0] = short_move(moves[k]);
+                shuffle[side][1] = make_move(move_dst(shuffle[side][0]), move_src(shuffle[side][0]));
+                break;
+            }
+    }
+
+    const int plies = 1022;
+    for (int ply = 0; ply < plies; ++ply)
+        board.move(shuffle[ply % 2][(ply / 2) % 2], NULL, false);
+
+    int side = plies % 2;
+    string fen = board.fen_string(side);
+    uint64_t hash = board.hash_code(side);
+
+    Agent agent;
+    MOVE result;
+    agent.search(board, side, &result, 60000, 60000, 4);
+
+    if (board.fen_string(side) != fen || board.hash_code(side) != hash)
+    {
+        cout << "FAIL: the board changed during the search" << endl;
+        return 1;
+    }
+
+    cout << "OK" << endl;
+    return 0;
+}
@@ -3,12 +3,14 @@
 #include <string>
 #include <stdint.h>
 
+#include "piece.h"
+
 typedef uint8_t POSITION;
 typedef uint16_t MOVE;
 
 const POSITION INVALID_POSITION = 255;
 
-inline POSITION make_position(int rank, int col)
+constexpr POSITION make_position(int rank, int col)
 {
     return (POSITION) ((rank << 4) | col);
 }
@@ -24,12 +26,12 @@ inline POSITION make_position(std::string s)
     }
 }
 
-inline int position_rank(POSITION p)
+constexpr int position_rank(POSITION p)
 {
     return p >> 4;
 }
 
-inline int position_file(POSITION p)
+constexpr int position_file(POSITION p)
 {
     return p & 0xf;
 }
@@ -84,3 +86,38 @@ inline bool are_inverse_moves(MOVE move1, MOVE move2)
 {
     return move_src(move1) == move_dst(move2) && move_dst(move1) == move_src(move2);
 }
+
+// A generated move together with what the generator knew about it: the MOVE in bits 0-15, the
+// moving piece in bits 16-19, the captured piece, or 0, in bits 20-23 and the capture ordering
+// score in bits 24-31. Only the MOVE part is kept in the transposition table and the history.
+typedef uint32_t FULL_MOVE;
+
+inline FULL_MOVE make_full_move(MOVE move, PIECE piece, PIECE captured, int score)
+{
+    return move | (piece << 16) | (captured << 20) | ((uint32_t) score << 24);
+}
+
+inline MOVE short_move(FULL_MOVE move)
+{
+    return move & 0xffff;
+}
+
+inline PIECE moving_piece(FULL_MOVE move)
+{
+    return (move >> 16) & 0xf;
+}
+
+inline PIECE captured_piece(FULL_MOVE move)
+{
+    return (move >> 20) & 0xf;
+}
+
+inline int order_score(FULL_MOVE move)
+{
+    return move >> 24;
+}
+
+inline FULL_MOVE with_order_score(FULL_MOVE move, int score)
+{
+    return (move & 0xffffff) | ((uint32_t) score << 24);
+}
@@ -1,10 +1,10 @@
 #include "movelist.h"
 #include "see.h"
 
-void remove_move(MOVE *moves, int *scores, int from, int &end, MOVE to_remove)
+void remove_move(FULL_MOVE *moves, int *scores, int from, int &end, MOVE to_remove)
 {
     for (int i = from; i < end; ++i)
-        if (moves[i] == to_remove)
+        if (short_move(moves[i]) == to_remove)
         {
             for (int j = i + 1; j < end; ++j)
             {
@@ -16,9 +16,9 @@ void remove_move(MOVE *moves, int *scores, int from, int &end, MOVE to_remove)
         }
 }
 
-void insert_move(MOVE *moves, int *scores, int index, int to)
+void insert_move(FULL_MOVE *moves, int *scores, int index, int to)
 {
-    MOVE t = moves[index];
+    FULL_MOVE t = moves[index];
     int tt = scores[index];
     for (int i = index; i - 1 >= to; --i)
     {
@@ -38,14 +38,17 @@ int select_best(int *scores, int from, int end)
     return ret;
 }
 
-MoveList::MoveList(Board *b, int s, MOVE fm, int *hs, MOVE k1, MOVE k2)
+MoveList::MoveList(Board *b, int s, bool ic, MOVE fm, int *hs, MOVE k1, MOVE k2)
     : board(b)
     , side(s)
+    , in_check(ic)
     , first_move(fm)
     , killer1(k1)
     , killer2(k2)
     , state(FIRST_MOVE)
     , history_scores(hs)
+    , killers_done_count(0)
+    , killer_index(0)
 {
 }
 
@@ -54,25 +57,29 @@ bool MoveList::remaining_moves()
     return state >= GENERATE_MOVES;
 }
 
-MOVE MoveList::next_move()
+FULL_MOVE MoveList::next_move()
 {
-    MOVE ret = 0;
+    FULL_MOVE ret = 0;
     switch (state)
     {
         case FIRST_MOVE:
             if (first_move != 0)
             {
-                ret = first_move;
+                ret = board->full_move(first_move);
                 state = GENERATE_CAPTURES;
                 break;
             }
 
         case GENERATE_CAPTURES:
-            board->generate_moves(side, moves, scores, &moves_count);
+            // When in check every evasion is generated here and the quiet stage adds nothing
+            if (in_check)
+                board->generate_evasions(side, moves, &moves_count);
+            else
+                board->generate_captures(side, moves, &moves_count);
             c = 0;
             for (int i = c; i < moves_count; ++i)
-                if (!(scores[i] > Board::NON_CAPTURE && is_winning_capture(board, moves[i], scores[i], side)))
-                    scores[i] = Board::NON_CAPTURE;
+                scores[i] = captured_piece(moves[i]) != 0 && is_winning_capture(board, moves[i], side)
+                    ? order_score(moves[i]) : Board::NON_CAPTURE;
             if (first_move != 0)
                 remove_move(moves, scores, 0, moves_count, first_move);
             state = GOOD_CAPTURES;
@@ -88,20 +95,57 @@ MOVE MoveList::next_move()
                     break;
                 }
                 else
-                    state = GENERATE_MOVES;
+                    state = KILLERS;
             }
 
+        case KILLERS:
+            // Killers come before the quiet moves are generated, so a cutoff by one saves the
+            // generation. Quiet ones are checked against the board; captures must still be listed.
+            while (!in_check && killer_index < 2)
+            {
+                MOVE killer = killer_index++ == 0 ? killer1 : killer2;
+                if (killer == 0 || killer == first_move || (killer_index == 2 && killer == killer1))
+                    continue;
+
+                if (board->piece_at(move_dst(killer)) != 0)
+                {
+                    int end = moves_count;
+                    remove_move(moves, scores, c, moves_count, killer);
+                    if (moves_count == end)
+                        continue;
+                }
+                else if (!board->is_pseudo_legal(side, killer) || !board->is_legal_move(side, killer))
+                    continue;
+                else
+                    killers_done[killers_done_count++] = killer;
+
+                ret = board->full_move(killer);
+                break;
+            }
+            if (ret != 0)
+                break;
+            state = GENERATE_MOVES;
+
         case GENERATE_MOVES:
+            if (!in_check)
+            {
+                int quiets_count;
+                board->generate_quiets(side, moves + moves_count, &quiets_count);
+                moves_count += quiets_count;
+            }
             if (first_move != 0)
                 remove_move(moves, scores, c, moves_count, first_move);
+            for (int i = 0; i < killers_done_count; ++i)
+                remove_move(moves, scores, c, moves_count, killers_done[i]);
             for (int i = c; i < moves_count; ++i)
             {
-                if (moves[i] == killer1)
+                MOVE move = short_move(moves[i]);
+                if (move == killer1)
                     scores[i] = KILLER1_SCORE;
-                else if (moves[i] == killer2)
+                else if (move == killer2)
                     scores[i] = KILLER2_SCORE;
                 else
-                    scores[i] = history_scores[moves[i]];
+                    scores[i] = history_scores[move];
             }
             state = OTHERS;
 
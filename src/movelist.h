@@ -5,14 +5,15 @@
 class MoveList
 {
     public:
-        MoveList(Board *board, int side, MOVE first_move, int *history_scores, MOVE killer1, MOVE killer2);
+        MoveList(Board *board, int side, bool in_check, MOVE first_move, int *history_scores, MOVE killer1, MOVE killer2);
 
-        MOVE next_move();
+        FULL_MOVE next_move();
         bool remaining_moves();
 
     private:
         Board *board;
         int side;
+        bool in_check;
         MOVE first_move, killer1, killer2;
 
         enum STATE
@@ -20,14 +21,19 @@ class MoveList
             FIRST_MOVE,
             GENERATE_CAPTURES,
             GOOD_CAPTURES,
+            KILLERS,
             GENERATE_MOVES,
             OTHERS
         };
         STATE state;
 
-        MOVE moves[120];
+        FULL_MOVE moves[120];
         int scores[120], *history_scores;
         int c, moves_count;
 
+        // Killers already returned, dropped from the quiet moves when they are generated
+        MOVE killers_done[2];
+        int killers_done_count, killer_index;
+
         static const int KILLER1_SCORE = 0x7fffffff, KILLER2_SCORE = 0x7ffffffe;
 };
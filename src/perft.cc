@@ -0,0 +1,137 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "perft.h"
+
+using namespace std;
+
+Perft::Perft(int hash_depth, int t)
+    : table(NULL)
+    , mask(0)
+    , threads(t < 1 ? 1 : t)
+{
+    if (hash_depth > 0)
+    {
+        mask = (((uint64_t) 1) << hash_depth) - 1;
+        table = new PerftEntry[mask + 1]();
+    }
+}
+
+Perft::~Perft()
+{
+    if (table)
+    {
+        delete[] table;
+        table = NULL;
+    }
+}
+
+uint64_t Perft::count(Board &board, int side, int depth)
+{
+    if (depth == 0)
+        return 1;
+
+    FULL_MOVE moves[120];
+    int moves_count;
+    board.generate_moves(side, moves, &moves_count);
+    if (depth == 1)
+        return moves_count;
+
+    // The depth is mixed into the key, since a position is reached at several depths
+    uint64_t key = board.hash_code(side) + depth * 0x9e3779b97f4a7c15ULL;
+    PerftEntry *entry = table ? &table[key & mask] : NULL;
+    if (entry)
+    {
+        uint64_t check = entry->check.load(memory_order_relaxed), count = entry->count.load(memory_order_relaxed);
+        if ((check ^ count) == key)
+            return count;
+    }
+
+    uint64_t ret = 0;
+    for (int i = 0; i < moves_count; ++i)
+    {
+        board.move(short_move(moves[i]), NULL, false);
+        ret += count(board, 1 - side, depth - 1);
+        board.unmove();
+    }
+
+    if (entry)
+    {
+        entry->check.store(key ^ ret, memory_order_relaxed);
+        entry->count.store(ret, memory_order_relaxed);
+    }
+    return ret;
+}
+
+uint64_t Perft::perft(Board &board, int side, int depth, FULL_MOVE *moves, uint64_t *counts, int *moves_count)
+{
+    FULL_MOVE own_moves[120];
+    uint64_t own_counts[120];
+    int own_count;
+    if (!moves)
+        moves = own_moves;
+    if (!counts)
+        counts = own_counts;
+    if (!moves_count)
+        moves_count = &own_count;
+
+    if (depth == 0)
+    {
+        *moves_count = 0;
+        return 1;
+    }
+    board.generate_moves(side, moves, moves_count);
+
+    // Each thread takes the next unclaimed root move; the extra threads start from the FEN
+    atomic<int> next(0);
+    int n = *moves_count;
+    string fen = board.fen_string(side);
+    auto work = [&](Board &b)
+    {
+        for (int i; (i = next++) < n;)
+        {
+            b.move(short_move(moves[i]), NULL, false);
+            counts[i] = count(b, 1 - side, depth - 1);
+            b.unmove();
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < threads && t < n; ++t)
+        workers.push_back(thread([&]()
+                    {
+                        Board b(fen);
+                        work(b);
+                    }));
+    work(board);
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+
+    uint64_t ret = 0;
+    for (int i = 0; i < n; ++i)
+        ret += counts[i];
+    return ret;
+}
+
+void print_perft(Board &board, int side, int depth, bool divide, int threads, int hash_depth)
+{
+    Perft perft(hash_depth, threads);
+    FULL_MOVE moves[120];
+    uint64_t counts[120];
+    int moves_count;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    uint64_t nodes = perft.perft(board, side, depth, moves, counts, &moves_count);
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (divide)
+    {
+        for (int i = 0; i < moves_count; ++i)
+            cout << move_string(short_move(moves[i])) << " " << counts[i] << endl;
+        cout << moves_count << " moves" << endl;
+    }
+    cout << "perft " << depth << ": " << nodes << " nodes in " << sec << "s, "
+        << (sec > 0 ? (double) nodes / sec / 1000000. : 0) << "m nodes/s" << endl;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "board.h"
+
+// Counts the leaves of the legal move tree, to time the board code on its own and to check
+// the move generator. Leaves are counted in bulk from the move counts one ply above them.
+// Subtree counts can be cached in a table keyed by Board::hash_code, and the root moves can
+// be shared among threads, each working on its own copy of the board.
+class Perft
+{
+    private:
+        Perft(const Perft &);
+        Perft &operator=(const Perft &);
+
+        // Written and read without locks: check holds the key xor the count, so an entry torn
+        // by two threads writing at once fails the check and is ignored.
+        typedef struct sPerftEntry
+        {
+            std::atomic<uint64_t> check, count;
+        } PerftEntry;
+
+        PerftEntry *table;
+        uint64_t mask;
+        int threads;
+
+        uint64_t count(Board &board, int side, int depth);
+
+    public:
+        // hash_depth is log2 of the number of table entries, or 0 for no table
+        Perft(int hash_depth = 0, int threads = 1);
+        ~Perft();
+
+        // Fills counts, if given, with the subtree size of each move from generate_moves
+        uint64_t perft(Board &board, int side, int depth, FULL_MOVE *moves = NULL, uint64_t *counts = NULL,
+                int *moves_count = NULL);
+};
+
+// Runs perft, or divide when divide is set, and prints the counts, the time taken and the speed
+void print_perft(Board &board, int side, int depth, bool divide, int threads, int hash_depth);
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cstdlib>
+#include <string>
+
+#include "perft.h"
+
+using namespace std;
+
+void usage(const char *name)
+{
+    cout << "Usage: " << name << " [-divide] [-threads N] [-hash DEPTH] depth [fen [w|b]]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    bool divide = false;
+    int threads = 1, hash_depth = 0, depth = -1, side = 1;
+    string fen = "rheakaehr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RHEAKAEHR";
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "-divide")
+            divide = true;
+        else if (arg == "-threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "-hash" && i + 1 < argc)
+            hash_depth = atoi(argv[++i]);
+        else if (positional == 0)
+        {
+            depth = atoi(argv[i]);
+            ++positional;
+        }
+        else if (positional == 1)
+        {
+            fen = arg;
+            ++positional;
+        }
+        else if (positional == 2)
+        {
+            side = arg == "b" ? 0 : 1;
+            ++positional;
+        }
+    }
+
+    if (depth < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Board board(fen);
+    print_perft(board, side, depth, divide, threads, hash_depth);
+    return 0;
+}
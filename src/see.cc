@@ -5,51 +5,56 @@
 
 using namespace std;
 
-bool is_winning_capture(Board *board, MOVE move, int score, int side)
+bool is_winning_capture(Board *board, FULL_MOVE move, int side)
 {
+    int score = order_score(move);
     int captured = (score >> 3), capturing = 8 - (score & 7);
     if (captured > capturing)
         return true;
 
-    return is_winning_capture(board, move, side);
+    return is_winning_exchange(board, short_move(move), side);
 }
 
-bool is_winning_capture(Board *board, MOVE move, int side)
+bool is_winning_exchange(Board *board, MOVE move, int side)
 {
-    int v = board->static_value(side);
-
-    MoveType mt;
-    if (!board->move(move, &mt))
-        return false;
-    if (mt == KING_CAPTURE)
-    {
-        board->unmove();
+    if (piece_type(board->piece_at(move_dst(move))) == PIECE_K)
         return true;
-    }
-
-    int ret = -static_exchange_eval(board, 1 - side, move_dst(move));
-
-    board->unmove();
 
-    return v <= ret;
+    return static_exchange_eval(board, move, side) >= 0;
 }
 
-int static_exchange_eval(Board *board, int side, POSITION pos)
+int static_exchange_eval(Board *board, MOVE move, int side)
 {
-    int ans = board->static_value(side);
-
-    MOVE response;
-    MoveType mt;
-    if (!board->is_attacked(pos, true, &response) || !board->move(response, &mt))
-        return ans;
-
-    int ret;
-    if (mt == KING_CAPTURE)
-        ret = INF;
-    else
-        ret = -static_exchange_eval(board, 1 - side, pos);
-
-    board->unmove();
+    // gains[d] is what the d-th capture on pos adds to the static value of the side making it
+    static const int MAX_CAPTURES = 32;
+    int gains[MAX_CAPTURES];
+    int depth = 0;
+
+    POSITION pos = move_dst(move), from = move_src(move);
+    PIECE victim = board->piece_at(pos);
+    Bitboard occupied = board->occupied_squares();
+    for (;;)
+    {
+        PIECE attacker = board->piece_at(from);
+        if (piece_type(victim) == PIECE_K)
+        {
+            gains[depth++] = INF;
+            break;
+        }
+        gains[depth++] = board->piece_value(victim, pos) + board->piece_value(attacker, pos)
+            - board->piece_value(attacker, from);
+
+        occupied.clear(position_square(from));
+        side = 1 - side;
+        victim = attacker;
+        from = board->least_valuable_attacker(pos, side, occupied);
+        if (from == INVALID_POSITION || depth == MAX_CAPTURES)
+            break;
+    }
 
-    return max(ans, ret);
+    // Every capture after the first may be declined
+    int value = 0;
+    while (--depth > 0)
+        value = max(0, gains[depth] - value);
+    return gains[0] - value;
 }
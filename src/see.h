@@ -2,7 +2,9 @@
 
 #include "board.h"
 
-bool is_winning_capture(Board *board, MOVE move, int score, int side);
-bool is_winning_capture(Board *board, MOVE move, int side);
+bool is_winning_capture(Board *board, FULL_MOVE move, int side);
+bool is_winning_exchange(Board *board, MOVE move, int side);
 
-int static_exchange_eval(Board *board, int side, POSITION pos);
+// What the capture move and the best exchange after it on the same square add to the static
+// value of side, found from the board's occupancy without making any move
+int static_exchange_eval(Board *board, MOVE move, int side);
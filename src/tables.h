@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "piece.h"
+#include "move.h"
+#include "bitboard.h"
+
+// Move and attack tables, generated by the compiler. Tables are indexed by the square numbers
+// of bitboard.h, so they cover the 90 squares and nothing else.
+
+// Sliding moves along one rank or file, looked up by the slider's index on the line
+// and the line's occupancy. Each field is a mask over the same line: empty squares
+// reachable directly, the first and second occupied squares in each direction (rook
+// captures or cannon screens, cannon captures), and empty squares between the two.
+typedef struct sSlideEntry
+{
+    uint16_t empty, first, second, beyond;
+} SlideEntry;
+
+typedef struct sBoardTables
+{
+    SlideEntry rank_slides[9][1 << 9], file_slides[10][1 << 10];
+
+    Bitboard king_masks[90], advisor_masks[90], elephant_masks[90], horse_masks[90];
+    Bitboard pawn_masks[2][90], pawn_attacker_masks[2][90];
+    Bitboard reach_masks[8][90];            // squares each piece type could move to on an empty board
+    Bitboard leg_masks[90], eye_masks[90];  // squares of the horses whose leg, and elephants whose eye, is a square
+
+    // Steps as (position, leg or eye) pairs ending with INVALID_POSITION: horse moves from a
+    // square, horses attacking a square, and elephant moves from a square. A step is blocked
+    // when its leg or eye is occupied.
+    POSITION horse_steps[90][9][2], horse_attacker_steps[90][9][2], elephant_steps[90][5][2];
+} BoardTables;
+
+constexpr bool table_inside(int i, int j)
+{
+    return i >= 0 && i < 10 && j >= 0 && j < 9;
+}
+
+constexpr bool table_in_palace(int side, int i, int j)
+{
+    return j >= 3 && j <= 5 && (side == 0 ? i >= 0 && i <= 2 : i >= 7 && i <= 9);
+}
+
+constexpr bool table_in_half(int side, int i, int j)
+{
+    return table_inside(i, j) && (side == 0 ? i <= 4 : i >= 5);
+}
+
+template <int length>
+constexpr void init_slides(SlideEntry (&entries)[length][1 << length])
+{
+    for (int index = 0; index < length; ++index)
+        for (int occupancy = 0; occupancy < (1 << length); ++occupancy)
+        {
+            SlideEntry &entry = entries[index][occupancy];
+            for (int d = -1; d <= 1; d += 2)
+            {
+                int k = index + d;
+                for (; k >= 0 && k < length && !(occupancy & (1 << k)); k += d)
+                    entry.empty |= 1 << k;
+                if (k < 0 || k >= length)
+                    continue;
+                entry.first |= 1 << k;
+                for (k += d; k >= 0 && k < length && !(occupancy & (1 << k)); k += d)
+                    entry.beyond |= 1 << k;
+                if (k >= 0 && k < length)
+                    entry.second |= 1 << k;
+            }
+        }
+}
+
+constexpr BoardTables make_board_tables()
+{
+    BoardTables t {};
+
+    init_slides(t.rank_slides);
+    init_slides(t.file_slides);
+
+    // Horse jumps and their legs, in the order moves are generated
+    const int horse_jumps[8][4] = {
+        {-2, 1, -1, 0}, {-1, 2, 0, 1}, {1, 2, 0, 1}, {2, 1, 1, 0},
+        {2, -1, 1, 0}, {1, -2, 0, -1}, {-1, -2, 0, -1}, {-2, -1, -1, 0}
+    };
+    int horse_attackers[90] {};
+
+    for (int i = 0; i < 10; ++i)
+        for (int j = 0; j < 9; ++j)
+        {
+            int sq = i * 9 + j, horses = 0, elephants = 0;
+
+            for (int di = -1; di <= 1; ++di)
+                for (int dj = -1; dj <= 1; ++dj)
+                {
+                    int oi = i + di, oj = j + dj;
+                    if ((di == 0) == (dj == 0) || !table_inside(oi, oj))
+                        continue;
+                    for (int side = 0; side <= 1; ++side)
+                        if (table_in_palace(side, i, j) && table_in_palace(side, oi, oj))
+                            t.king_masks[sq].set(oi * 9 + oj);
+                }
+
+            for (int di = -1; di <= 1; di += 2)
+                for (int dj = -1; dj <= 1; dj += 2)
+                {
+                    int ei = i + 2 * di, ej = j + 2 * dj;
+                    for (int side = 0; side <= 1; ++side)
+                    {
+                        if (table_in_palace(side, i, j) && table_in_palace(side, i + di, j + dj))
+                            t.advisor_masks[sq].set((i + di) * 9 + j + dj);
+
+                        // Elephants stand on the seven squares of their own half whose rank, counted
+                        // from their own edge, and file are even and add up to 2 modulo 4
+                        int ri = side == 0 ? i : 9 - i;
+                        if (table_in_half(side, i, j) && table_in_half(side, ei, ej)
+                                && ri % 2 == 0 && j % 2 == 0 && (ri + j) % 4 == 2)
+                        {
+                            t.elephant_masks[sq].set(ei * 9 + ej);
+                            t.eye_masks[(i + di) * 9 + j + dj].set(sq);
+                            t.elephant_steps[sq][elephants][0] = make_position(ei, ej);
+                            t.elephant_steps[sq][elephants++][1] = make_position(i + di, j + dj);
+                        }
+                    }
+                }
+
+            for (int r = 0; r < 8; ++r)
+            {
+                int hi = i + horse_jumps[r][0], hj = j + horse_jumps[r][1];
+                if (!table_inside(hi, hj))
+                    continue;
+                POSITION leg = make_position(i + horse_jumps[r][2], j + horse_jumps[r][3]);
+                int target = hi * 9 + hj;
+
+                t.horse_masks[sq].set(target);
+                t.leg_masks[(i + horse_jumps[r][2]) * 9 + j + horse_jumps[r][3]].set(sq);
+                t.horse_steps[sq][horses][0] = make_position(hi, hj);
+                t.horse_steps[sq][horses++][1] = leg;
+                t.horse_attacker_steps[target][horse_attackers[target]][0] = make_position(i, j);
+                t.horse_attacker_steps[target][horse_attackers[target]++][1] = leg;
+            }
+
+            t.horse_steps[sq][horses][0] = INVALID_POSITION;
+            t.elephant_steps[sq][elephants][0] = INVALID_POSITION;
+
+            // Pawns step forward, and sideways once across the river; side 0 moves down the ranks
+            for (int side = 0; side <= 1; ++side)
+            {
+                int forward = side == 0 ? 1 : -1;
+                bool crossed = !table_in_half(side, i, j);
+                if (!crossed && (j % 2 != 0 || (side == 0 ? i < 3 : i > 6)))
+                    continue;
+
+                if (table_inside(i + forward, j))
+                    t.pawn_masks[side][sq].set((i + forward) * 9 + j);
+                for (int dj = -1; crossed && dj <= 1; dj += 2)
+                    if (table_inside(i, j + dj))
+                        t.pawn_masks[side][sq].set(i * 9 + j + dj);
+
+                Bitboard targets = t.pawn_masks[side][sq];
+                while (!targets.empty())
+                    t.pawn_attacker_masks[side][targets.pop()].set(sq);
+            }
+        }
+
+    for (int sq = 0; sq < 90; ++sq)
+    {
+        t.horse_attacker_steps[sq][horse_attackers[sq]][0] = INVALID_POSITION;
+
+        for (int k = 0; k < 90; ++k)
+            if (k != sq && (k / 9 == sq / 9 || k % 9 == sq % 9))
+            {
+                t.reach_masks[PIECE_R][sq].set(k);
+                t.reach_masks[PIECE_C][sq].set(k);
+            }
+        t.reach_masks[PIECE_K][sq] = t.king_masks[sq];
+        t.reach_masks[PIECE_A][sq] = t.advisor_masks[sq];
+        t.reach_masks[PIECE_E][sq] = t.elephant_masks[sq];
+        t.reach_masks[PIECE_H][sq] = t.horse_masks[sq];
+        t.reach_masks[PIECE_P][sq] = t.pawn_masks[0][sq] | t.pawn_masks[1][sq];
+    }
+
+    return t;
+}
@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "time_control.h"
+
+using namespace std;
+
+TimeControl::TimeControl()
+    : move_time(5000)
+    , moves_per_session(0)
+    , base(0)
+    , increment(0)
+    , remaining(0)
+    , opponent_remaining(0)
+{
+}
+
+bool TimeControl::set_level(const char *mps, const char *base_string, const char *increment_string)
+{
+    int moves, minutes, seconds = 0;
+    double inc;
+    if (sscanf(mps, "%d", &moves) != 1 || sscanf(base_string, "%d:%d", &minutes, &seconds) < 1
+            || sscanf(increment_string, "%lf", &inc) != 1)
+        return false;
+
+    move_time = 0;
+    moves_per_session = max(moves, 0);
+    base = (minutes * 60 + seconds) * 1000;
+    increment = (int) (inc * 1000);
+    remaining = opponent_remaining = base;
+    return true;
+}
+
+void TimeControl::set_move_time(double seconds)
+{
+    move_time = max((int) (seconds * 1000), MIN_TIME);
+}
+
+void TimeControl::set_remaining(int centiseconds)
+{
+    remaining = centiseconds * 10;
+}
+
+void TimeControl::set_opponent_remaining(int centiseconds)
+{
+    opponent_remaining = centiseconds * 10;
+}
+
+void TimeControl::new_game()
+{
+    remaining = opponent_remaining = base;
+}
+
+void TimeControl::limits(int ply, int *soft, int *hard)
+{
+    if (move_time > 0)
+    {
+        *soft = *hard = max(move_time - SAFETY_MARGIN, MIN_TIME);
+        return;
+    }
+
+    // The side to move has made ply / 2 moves, whichever side started
+    int usable = max(remaining - SAFETY_MARGIN, MIN_TIME);
+    int moves_played = ply / 2;
+    int moves_to_go = moves_per_session > 0 ? moves_per_session - moves_played % moves_per_session : EXPECTED_MOVES;
+
+    // An even share of the clock, plus most of the increment, plus a little of any lead over
+    // the opponent's clock
+    int share = usable / moves_to_go + increment * 3 / 4;
+    if (opponent_remaining > 0 && remaining > opponent_remaining)
+        share += (remaining - opponent_remaining) / (4 * moves_to_go);
+
+    // The hard limit lets an unstable search run on to three shares, but never past half of
+    // what is left, unless this is the last move before the control
+    *soft = min(share, usable);
+    *hard = moves_to_go == 1 ? usable : max(*soft, min(*soft * 3, usable / 2));
+    *soft = max(*soft, MIN_TIME);
+    *hard = max(*hard, *soft);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// The clock as xboard describes it, turned into time limits for each move. Times are in
+// milliseconds of wall time.
+class TimeControl
+{
+    private:
+        // Either a fixed time per move (st), or a clock: moves_per_session moves, 0 for the
+        // whole game, in base plus increment for each move made
+        int move_time;
+        int moves_per_session, base, increment;
+        int remaining, opponent_remaining;
+
+        // Kept back from the clock for the engine and interface overhead on each move
+        static constexpr int SAFETY_MARGIN = 50;
+        // Moves the remaining time is spread over when the game has no more controls
+        static constexpr int EXPECTED_MOVES = 30;
+        static constexpr int MIN_TIME = 10;
+
+    public:
+        TimeControl();
+
+        // level MPS BASE INC, with BASE in minutes or minutes:seconds and INC in seconds;
+        // returns false when they do not parse
+        bool set_level(const char *mps, const char *base, const char *increment);
+        // st SECONDS
+        void set_move_time(double seconds);
+        // time and otim, in centiseconds
+        void set_remaining(int centiseconds);
+        void set_opponent_remaining(int centiseconds);
+
+        void new_game();
+
+        // Limits for the next move, after ply moves of both sides in the game: the search should
+        // not start a new iteration after soft milliseconds, stretched or shrunk by how stable
+        // its best move is, and must stop at hard
+        void limits(int ply, int *soft, int *hard);
+};
@@ -1,5 +1,3 @@
-#include <iostream>
-
 #include "transposition.h"
 
 using namespace std;
@@ -11,7 +9,6 @@ Transposition::Transposition(int table_depth)
     if (t_depth < 10)
         t_depth = 10;
     mask = ((((uint64_t) 1) << t_depth) - 1);
-    rev_mask = ~mask;
     clear();
 }
 
@@ -29,16 +26,4 @@ void Transposition::clear()
     if (table)
         delete[] table;
     table = new TranspositionEntry[1 << t_depth]();
-
-    access = 0;
-    collision = 0;
-    used = 0;
-}
-
-void Transposition::stat()
-{
-    int tot = (1 << t_depth);
-    cout << "# transposition collision rate: " << collision << "/" << access << " (" << (double) collision * 100 / (double) access << "%)" << endl;
-    cout << "# transposition usage: " << used << " out of " << tot << ", "
-       << (double) used * 100 / (double) tot << "%" << endl;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
 #include "move.h"
 
 class Transposition
@@ -11,18 +12,20 @@ class Transposition
         bool operator==(const Transposition &);
 
     protected:
+        // Shared by the search threads and written without locks. value packs everything stored
+        // and check holds the whole key xor value, so an entry torn by two threads writing at once
+        // fails the check and is missed. value holds, from the top, the score in 32 bits, the
+        // depth in 14, exact in 2 and the move in 16.
         typedef struct sTranspositionEntry
         {
-            uint64_t key;
-            int64_t value;
+            std::atomic<uint64_t> check;
+            std::atomic<int64_t> value;
         } TranspositionEntry;
 
-        uint64_t mask, rev_mask;
+        uint64_t mask;
         int t_depth;
         TranspositionEntry *table;
 
-        int used, access, collision;
-
     public:
         // table_depth should be at least 10
         Transposition(int table_depth);
@@ -31,35 +34,29 @@ class Transposition
         inline void put(uint64_t key, int score, int exact, MOVE move, int depth)
         {
             int index = (int) (key & mask);
-            if (table[index].key == 0)
-                ++used;
-            table[index].key = (key & rev_mask) | (depth << 2) | exact;
-            table[index].value = (score << 16) | move;
+            int64_t value = (int64_t) ((uint64_t) (int64_t) score << 32 | (uint64_t) (depth & 0x3fff) << 18
+                    | (uint64_t) exact << 16 | move);
+            table[index].check.store(key ^ (uint64_t) value, std::memory_order_relaxed);
+            table[index].value.store(value, std::memory_order_relaxed);
         }
 
 
         inline bool get(uint64_t key, int *score, int *exact, MOVE *move, int *depth)
         {
-            ++access;
             int index = (int) (key & mask);
-            if (table[index].key == 0 || (table[index].key & rev_mask) != (key & rev_mask))
-            {
-                if (table[index].key != 0)
-                    ++collision;
+            uint64_t check = table[index].check.load(std::memory_order_relaxed);
+            int64_t value = table[index].value.load(std::memory_order_relaxed);
+            if ((check ^ (uint64_t) value) != key)
                 return false;
-            }
-            int t = table[index].key & mask;
-            *depth = t >> 2;
-            *exact = t & 3;
-            *score = table[index].value >> 16;
-            *move = table[index].value & 0xffff;
+            *depth = (value >> 18) & 0x3fff;
+            *exact = (value >> 16) & 3;
+            *score = (int) (value >> 32);
+            *move = value & 0xffff;
             return true;
         }
 
 
         void clear();
 
-        void stat();
-
         static const int EXACT = 1, UPPER = 2, LOWER = 3;
 };
@@ -3,15 +3,17 @@
 #include <sstream>
 #include <string>
 #include <ctime>
+#include <cstdlib>
 
 #include "common.h"
 #include "agent.h"
+#include "perft.h"
+#include "time_control.h"
 
 using namespace std;
 
-string feature_string = "feature myname=\"Deep Blur\" setboard=1 analyze=0 sigint=0 sigterm=0 reuse=0 variants=\"xiangqi\" nps=0 debug=1 done=1";
-
-const int move_time = 5000;
+string feature_string = "feature myname=\"Deep Blur\" setboard=1 analyze=1 sigint=0 sigterm=0 reuse=0 variants=\"xiangqi\" nps=0 smp=1 debug=1 "
+    "option=\"Parallel -combo *Lazy SMP /// ABDADA\" option=\"Analysis interval -spin 1000 100 60000\" done=1";
 
 bool is_square(char c)
 {
@@ -29,17 +31,18 @@ bool is_move(string s)
             && is_rank(s[1]) && is_square(s[2]) && is_rank(s[3]));
 }
 
-void go(Board &board, Agent &agent, int &side, int time_limit, int depth = 128)
+// Plays the result of a search, or resigns, and ponders on the expected reply when asked to
+void play(Board &board, Agent &agent, int &side, int &ply, int score, MOVE res, bool ponder)
 {
-    MOVE res;
-
-    int score = agent.search(board, side, &res, time_limit, depth);
     if (score > -INF)
     {
         board.move(res);
         side = 1 - side;
+        ++ply;
 
         cout << "move " << move_string(res) << endl;
+        if (ponder)
+            agent.start_ponder(board, side);
     }
     else
     {
@@ -50,16 +53,28 @@ void go(Board &board, Agent &agent, int &side, int time_limit, int depth = 128)
     }
 }
 
+void go(Board &board, Agent &agent, TimeControl &clock, int &side, int &ply, bool ponder)
+{
+    int soft, hard;
+    clock.limits(ply, &soft, &hard);
+
+    MOVE res;
+    int score = agent.search(board, side, &res, soft, hard, MAX_DEPTH);
+    play(board, agent, side, ply, score, res, ponder);
+}
+
 int main()
 {
     Board board;
     Agent agent;
+    TimeControl clock;
 
     string s;
     string line;
     int side = 1;
-    int remaining_time = 5000;
-    bool force = false;
+    // Moves of both sides in the game, those before a setboard position included
+    int ply = 0;
+    bool force = false, ponder = false, analyzing = false;
 
     while (getline(cin, line))
     {
@@ -67,6 +82,12 @@ int main()
         string command;
         iss >> command;
 
+        // Only the clock updates, status requests and the expected reply leave a background
+        // search running; analysis restarts below on the new position
+        bool ponder_hit = agent.is_pondering() && is_move(command) && make_move(command) == agent.ponder_reply();
+        if (!ponder_hit && command != "time" && command != "otim" && command != ".")
+            agent.stop_background();
+
         if (command == "protover")
             cout << feature_string << endl;
         else if (command == "force")
@@ -86,9 +107,23 @@ int main()
                     cout << "# Warning: perpetual check" << endl;
 
                 side = 1 - side;
+                ++ply;
+
+                if (ponder_hit && !force)
+                {
+                    int soft, hard;
+                    clock.limits(ply, &soft, &hard);
 
-                if (!force)
-                    go(board, agent, side, min(move_time, remaining_time));
+                    MOVE res;
+                    int score = agent.finish_ponder(&res, soft, hard);
+                    play(board, agent, side, ply, score, res, ponder);
+                }
+                else
+                {
+                    agent.stop_background();
+                    if (!force && !analyzing)
+                        go(board, agent, clock, side, ply, ponder);
+                }
             }
         }
         else if (command == "print")
@@ -98,37 +133,52 @@ int main()
         }
         else if (command == "undo")
         {
-            board.checked_unmove();
+            if (board.checked_unmove())
+                --ply;
             side = 1 - side;
         }
         else if (command == "remove")
         {
-            board.checked_unmove();
-            board.checked_unmove();
+            for (int i = 0; i < 2; ++i)
+                if (board.checked_unmove())
+                    --ply;
         }
         else if (command == "setboard")
         {
-            string fen, turn;
+            // setboard FEN: the placement, the side to move, two unused fields, the halfmove
+            // clock and the number of the full move to be played, 1 when it is missing
+            string fen, turn, castling, en_passant;
+            int halfmoves, fullmove;
             iss >> fen >> turn;
             board.set(fen);
             if (turn == "b")
                 side = 0;
             else
                 side = 1;
+            if (!(iss >> castling >> en_passant >> halfmoves >> fullmove) || fullmove < 1)
+                fullmove = 1;
+            ply = (fullmove - 1) * 2 + (side == 0 ? 1 : 0);
         }
         else if (command == "generate")
         {
             int generate_side = 0;
             iss >> generate_side;
 
-            MOVE moves[120];
-            int capture_scores[120], moves_count;
-            board.generate_moves(generate_side, moves, capture_scores, &moves_count);
+            FULL_MOVE moves[120];
+            int moves_count;
+            board.generate_moves(generate_side, moves, &moves_count);
 
             for (int i = 0; i < moves_count; ++i)
-                cout << move_string(moves[i]) << " ";
+                cout << move_string(short_move(moves[i])) << " ";
             cout << endl << moves_count << " moves in all." << endl;
         }
+        else if (command == "perft" || command == "divide")
+        {
+            // perft DEPTH [THREADS [HASH_DEPTH]]
+            int depth = 1, threads = 1, hash_depth = 0;
+            iss >> depth >> threads >> hash_depth;
+            print_perft(board, side, depth, command == "divide", threads, hash_depth);
+        }
         else if (command == "quit")
             break;
         else if (command == "go")
@@ -136,34 +186,91 @@ int main()
             force = false;
             int depth;
             if (iss >> depth)
-                go(board, agent, side, 10 * 3600 * 1000, depth);
+            {
+                const int no_limit = 10 * 3600 * 1000;
+                MOVE res;
+                int score = agent.search(board, side, &res, no_limit, no_limit, depth);
+                play(board, agent, side, ply, score, res, ponder);
+            }
             else
-                go(board, agent, side, min(move_time, remaining_time));
+                go(board, agent, clock, side, ply, ponder);
         }
         else if (command == "qs")
         {
             cout << agent.quiescence(board, side, -INF, INF) << endl;
         }
-        else if (command == "xboard" || command == "new" || command == "random" || command == "accepted" || command == "rejected"
-                || command == "variant" || command == "post" || command == "hard" || command == "computer")
+        else if (command == "new")
+        {
+            clock.new_game();
+            ply = 0;
+        }
+        else if (command == "xboard" || command == "random" || command == "accepted" || command == "rejected"
+                || command == "variant" || command == "post" || command == "computer")
         {
             // do nothing
         }
+        else if (command == "hard")
+            ponder = true;
+        else if (command == "easy")
+            ponder = false;
+        else if (command == "cores")
+        {
+            int cores = 1;
+            iss >> cores;
+            agent.set_threads(cores);
+        }
+        else if (command == "option")
+        {
+            string option;
+            getline(iss >> ws, option);
+            if (option == "Parallel=Lazy SMP")
+                agent.set_parallel_mode(Agent::LAZY_SMP);
+            else if (option == "Parallel=ABDADA")
+                agent.set_parallel_mode(Agent::ABDADA);
+            else if (option.compare(0, 18, "Analysis interval=") == 0)
+                agent.set_report_interval(max(100, atoi(option.c_str() + 18)));
+            else
+                cout << "Error (unknown option): " << option << endl;
+        }
+        else if (command == "analyze")
+            analyzing = true;
+        else if (command == "exit")
+            analyzing = false;
+        else if (command == ".")
+            agent.request_status();
         else if (command == "level")
         {
+            string mps, base, increment;
+            iss >> mps >> base >> increment;
+            if (!clock.set_level(mps.c_str(), base.c_str(), increment.c_str()))
+                cout << "Error (bad level): " << line << endl;
+        }
+        else if (command == "st")
+        {
+            double seconds = 0;
+            iss >> seconds;
+            clock.set_move_time(seconds);
         }
         else if (command == "time")
         {
-            int t;
+            int t = 0;
             iss >> t;
-            remaining_time = t * 10;
+            clock.set_remaining(t);
         }
         else if (command == "otim")
         {
+            int t = 0;
+            iss >> t;
+            clock.set_opponent_remaining(t);
         }
         else
             cout << "Error (unknown command): " << line << endl;
+
+        if (analyzing && !agent.is_analyzing())
+            agent.start_analysis(board, side);
     }
 
+    agent.stop_background();
+
     return 0;
 }